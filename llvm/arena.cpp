@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "arena.hpp"
+
+thread_local CompilationArenas *compilationArenas = nullptr;
+
+// Chunks start small, for short programs, and double up to a bound
+static const std::size_t firstChunkSize = 64 * 1024, maxChunkSize = 4 * 1024 * 1024;
+
+Arena::~Arena()
+{
+    release();
+}
+
+void Arena::grow(std::size_t size)
+{
+    std::size_t chunkSize = chunks ? std::min(chunks->size * 2, maxChunkSize) : firstChunkSize;
+    if (chunkSize < size + sizeof(Chunk))
+        chunkSize = size + sizeof(Chunk);
+    Chunk *chunk = (Chunk *)std::malloc(chunkSize);
+    if (!chunk)
+    {
+        std::cerr << "Out of memory" << std::endl;
+        exit(1);
+    }
+    chunk->prev = chunks;
+    chunk->size = chunkSize;
+    chunks = chunk;
+    next = (char *)(chunk + 1);
+    end = (char *)chunk + chunkSize;
+}
+
+void Arena::release()
+{
+    while (chunks)
+    {
+        Chunk *prev = chunks->prev;
+        std::free(chunks);
+        chunks = prev;
+    }
+    next = end = nullptr;
+    allocated = 0;
+}
+
+std::size_t Arena::bytesAllocated()
+{
+    return allocated;
+}
+
+ArenaScope::ArenaScope()
+    : outer(compilationArenas)
+{
+    compilationArenas = &arenas;
+}
+ArenaScope::~ArenaScope()
+{
+    compilationArenas = outer;
+}
+
+// Made on first use, as the tables allocate types while statically initialized
+static CompilationArenas &permanentArenas()
+{
+    static CompilationArenas *arenas = new CompilationArenas();
+    return *arenas;
+}
+
+Arena &astArena()
+{
+    return (compilationArenas ? *compilationArenas : permanentArenas()).ast;
+}
+Arena &typeArena()
+{
+    return (compilationArenas ? *compilationArenas : permanentArenas()).types;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+/** Bump allocator whose memory is released all at once. Objects in it are
+ * never destroyed, so whatever they own elsewhere is not freed either */
+class Arena
+{
+    struct Chunk
+    {
+        Chunk *prev;
+        std::size_t size;
+    };
+    Chunk *chunks = nullptr;
+    char *next = nullptr, *end = nullptr;
+    std::size_t allocated = 0;
+
+    void grow(std::size_t size);
+
+public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena();
+
+    void *allocate(std::size_t size, std::size_t align = alignof(std::max_align_t))
+    {
+        char *aligned = (char *)(((std::size_t)next + align - 1) & ~(align - 1));
+        if (!next || aligned + size > end)
+        {
+            grow(size + align);
+            aligned = (char *)(((std::size_t)next + align - 1) & ~(align - 1));
+        }
+        next = aligned + size;
+        allocated += size;
+        return aligned;
+    }
+    template <class T, class... Args>
+    T *make(Args &&...args)
+    {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+    /** Frees every chunk, invalidating everything allocated so far */
+    void release();
+    std::size_t bytesAllocated();
+};
+
+/** The arenas of a compilation, one per lifetime: the AST lives until code
+ * is generated, type graphs as long as the symbol tables refer to them */
+struct CompilationArenas
+{
+    Arena ast, types;
+};
+
+/** While it exists, the nodes made in its thread are allocated from its
+ * arenas, which are all released when it is destroyed. Outside of any
+ * (e.g. the types the tables are initialized with) they come from arenas
+ * that are never released */
+class ArenaScope
+{
+    CompilationArenas arenas;
+    CompilationArenas *outer;
+
+public:
+    ArenaScope();
+    ~ArenaScope();
+};
+
+extern thread_local CompilationArenas *compilationArenas;
+
+Arena &astArena();
+Arena &typeArena();
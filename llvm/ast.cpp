@@ -19,14 +19,14 @@ void printColorString(std::string s, int width, int format = 0, int color = 37,
               << s
               << outro;
 }
-Identifier::Identifier(std::string id, int line)
+Identifier::Identifier(Symbol id, int line)
     : id(id), line(line)
 {
     TG = st.lookup(id)->getTypeGraph();
 }
 std::string Identifier::getName()
 {
-    return id;
+    return id.str();
 }
 std::string Identifier::getTypeString()
 {
@@ -89,13 +89,13 @@ void AST::printIdTypeGraphs()
         ident->printIdLine(lineWidth, idWidth, typeWidth);
     }
 }
-void AST::addToIdList(std::string id)
+void AST::addToIdList(Symbol id)
 {
     AST_identifier_list.push_back(new Identifier(id, line_number));
 }
 AST::AST()
 {
-    line_number = yylineno;
+    line_number = currentLine;
 }
 AST::~AST()
 {
@@ -107,7 +107,7 @@ Type::Type(category c)
 UnknownType::UnknownType()
     : Type(category::CATEGORY_unknown)
 {
-    TG = new UnknownTypeGraph(true, true, false);
+    // Its TypeGraph is made in sem, type variables are shared by every parse
 }
 BasicType::BasicType(type t)
     : Type(category::CATEGORY_basic), t(t)
@@ -125,36 +125,40 @@ RefType::RefType(Type *ref_type)
     : Type(category::CATEGORY_ref), ref_type(ref_type)
 {
 }
-CustomType::CustomType(std::string *id)
-    : Type(category::CATEGORY_custom), id(*id)
+CustomType::CustomType(Symbol id)
+    : Type(category::CATEGORY_custom), id(id)
 {
 }
 
-Constr::Constr(std::string *Id, std::vector<Type *> *t)
-    : Id(*Id), type_list(*t) {}
-Par::Par(std::string *id, Type *t)
-    : id(*id), T(t) {}
+Constr::Constr(Symbol Id, std::vector<Type *> *t)
+    : Id(Id), type_list(*t) {}
+Par::Par(Symbol id, Type *t)
+    : id(id), T(t) {}
 
-DefStmt::DefStmt(std::string id)
+DefStmt::DefStmt(Symbol id)
     : id(id) {}
-Tdef::Tdef(std::string *id, std::vector<Constr *> *c)
-    : DefStmt(*id), constr_list(*c) {}
-Def::Def(std::string id, Type *t)
+Tdef::Tdef(Symbol id, std::vector<Constr *> *c)
+    : DefStmt(id), constr_list(*c) {}
+Def::Def(Symbol id, Type *t)
     : DefStmt(id), T(t) {}
-Constant::Constant(std::string *id, Expr *e, Type *t)
-    : Def(*id, t), expr(e) {}
-Function::Function(std::string *id, std::vector<Par *> *p, Expr *e, Type *t)
+Constant::Constant(Symbol id, Expr *e, Type *t)
+    : Def(id, t), expr(e) {}
+Function::Function(Symbol id, std::vector<Par *> *p, Expr *e, Type *t)
     : Constant(id, e, t), par_list(*p), 
     funcPrototype(nullptr), envStructType(nullptr) {}
-Mutable::Mutable(std::string id, Type *T)
+Mutable::Mutable(Symbol id, Type *T)
     : Def(id, T) {}
-Array::Array(std::string *id, std::vector<Expr *> *e, Type *T)
-    : Mutable(*id, T), expr_list(*e) {}
-Variable::Variable(std::string *id, Type *T)
-    : Mutable(*id, T) {}
+Array::Array(Symbol id, std::vector<Expr *> *e, Type *T)
+    : Mutable(id, T), expr_list(*e) {}
+Variable::Variable(Symbol id, Type *T)
+    : Mutable(id, T) {}
 
 Letdef::Letdef(std::vector<DefStmt *> *d, bool rec)
     : recursive(rec), def_list(*d) {}
+std::vector<DefStmt *> &Letdef::getDefList()
+{
+    return def_list;
+}
 Typedef::Typedef(std::vector<DefStmt *> *t)
     : tdef_list(*t) {}
 Program::~Program()
@@ -244,29 +248,29 @@ New::New(Type *t)
 
 While::While(Expr *e1, Expr *e2)
     : cond(e1), body(e2) {}
-For::For(std::string *id, Expr *e1, std::string s, Expr *e2, Expr *e3)
-    : id(*id), step(s), start(e1), finish(e2), body(e3) {}
+For::For(Symbol id, Expr *e1, std::string s, Expr *e2, Expr *e3)
+    : id(id), step(s), start(e1), finish(e2), body(e3) {}
 If::If(Expr *e1, Expr *e2, Expr *e3)
     : cond(e1), body(e2), else_body(e3) {}
 
-Dim::Dim(std::string *id, Int_literal *dim)
-    : dim(dim), id(*id) {}
+Dim::Dim(Symbol id, Int_literal *dim)
+    : dim(dim), id(id) {}
 
-ConstantCall::ConstantCall(std::string *id)
-    : id(*id) {}
-FunctionCall::FunctionCall(std::string *id, std::vector<Expr *> *expr_list)
+ConstantCall::ConstantCall(Symbol id)
+    : id(id) {}
+FunctionCall::FunctionCall(Symbol id, std::vector<Expr *> *expr_list)
     : ConstantCall(id), expr_list(*expr_list) {}
-ConstructorCall::ConstructorCall(std::string *Id, std::vector<Expr *> *expr_list)
-    : Id(*Id), expr_list(*expr_list) {}
-ArrayAccess::ArrayAccess(std::string *id, std::vector<Expr *> *expr_list)
-    : id(*id), expr_list(*expr_list) {}
+ConstructorCall::ConstructorCall(Symbol Id, std::vector<Expr *> *expr_list)
+    : Id(Id), expr_list(*expr_list) {}
+ArrayAccess::ArrayAccess(Symbol id, std::vector<Expr *> *expr_list)
+    : id(id), expr_list(*expr_list) {}
 
 PatternLiteral::PatternLiteral(Literal *l)
     : literal(l) {}
-PatternId::PatternId(std::string *id)
-    : id(*id) {}
-PatternConstr::PatternConstr(std::string *Id, std::vector<Pattern *> *p_list)
-    : Id(*Id), pattern_list(*p_list)
+PatternId::PatternId(Symbol id)
+    : id(id) {}
+PatternConstr::PatternConstr(Symbol Id, std::vector<Pattern *> *p_list)
+    : Id(Id), pattern_list(*p_list)
 {
     constrTypeGraph = nullptr;
 }
@@ -4,8 +4,8 @@
 #include <map>
 #include <vector>
 #include <iomanip>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/IRBuilder.h>
-#include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/Verifier.h>
@@ -13,6 +13,7 @@
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/Scalar/GVN.h>
 
+#include "arena.hpp"
 #include "symbol.hpp"
 #include "types.hpp"
 #include "infer.hpp"
@@ -50,12 +51,12 @@ extern TypeGraph *type_char;
 class Identifier
 {
 protected:
-    std::string id;
+    Symbol id;
     TypeGraph *TG;
     int line;
 
 public:
-    Identifier(std::string id, int line);
+    Identifier(Symbol id, int line);
     std::string getName();
     std::string getTypeString();
     std::string getLine();
@@ -68,6 +69,7 @@ extern std::vector<Identifier *> AST_identifier_list;
 
 class Function;
 class LivenessEntry;
+struct Fragment;
 
 /********************************************************************/
 
@@ -84,9 +86,18 @@ protected:
     static llvm::LLVMContext TheContext;
     static llvm::IRBuilder<> Builder;
     static llvm::Module *TheModule;
-    static llvm::legacy::FunctionPassManager *TheFPM;
 
     static llvm::TargetMachine *TargetMachine;
+    static bool prepared;
+    static std::string targetCPU, targetFeatures;
+    static int optimizationLevel;
+    // Set when top-level functions are compiled to objects of their own
+    static bool incremental;
+    // Set when compiling a module (-module), names its exported symbols
+    static std::string moduleName;
+    // Set when function values are {code, environment} pairs (-closures=fat)
+    // instead of trampolines
+    static bool fatClosures;
 
     static llvm::Type *i1;
     static llvm::Type *i8;
@@ -109,40 +120,94 @@ protected:
     static llvm::Function *createFuncAdapterFromCharArrToString(llvm::Function *charArrFunc);
     static llvm::Function *createFuncAdapterFromVoidToUnit(llvm::Function *voidFunc);
     static llvm::Function *createFuncAdapterFromStringToCharArr(llvm::Function *stringFunc);
+    static llvm::Function *createFuncAdapterWithEnv(llvm::Function *libFunc);
+    /** @return The value of a library function, which is a closure of an adapter with fat closures */
+    static llvm::Value *libFunctionValue(llvm::Function *libFunc);
 
-    llvm::Value *globalLiveValue = nullptr;
+    // Only for top-level definitions when compiling incrementally,
+    // names their symbols so that they can be shared between objects
+    std::string linkName = "";
 public:
     AST();
     virtual ~AST();
+    /** Nodes are allocated in the compilation's arena and freed with it */
+    static void *operator new(std::size_t size) { return astArena().allocate(size); }
+    static void operator delete(void *) {}
     virtual void printOn(std::ostream &out) const = 0;
+    /** Prints like printOn, but equal subtrees always print equally */
+    std::string canonicalString() const;
     virtual void sem();
-    llvm::Value *getGlobalLiveValue();
-    llvm::Value *updateGlobalValue(llvm::Value *newVal);
+    /** Binds every use of a symbol to its definition, see resolve.cpp */
+    virtual void resolve();
     virtual void liveness(Function *prevFunc);
+    /** Marks the calls in tail position of the body of f, see liveness.cpp */
+    virtual void markTailCalls(Function *f);
     void addFunctionThatNeedsSymbol(Function *f);
+    void setLinkName(std::string name);
+    std::string getLinkName();
+    /** Fingerprints a top-level definition, see Program::planFragments
+     * @param context Hashed into the fingerprint as well
+     * @param ordinals Top-level definitions seen so far with each name */
+    virtual void planFragment(std::string context, std::map<std::string, int> &ordinals);
     static llvm::Value *equalityHelper(llvm::Value *lhsVal, llvm::Value *rhsVal,
                                        TypeGraph *type, bool structural, llvm::IRBuilder<> TmpB);
     virtual llvm::Value *compile();
-    void start_compilation(const char *programName, bool optimize = false);
-    std::vector<std::pair<std::string, llvm::Function *>> *genLibGlueLogic();
+    static void createTargetMachine();
+    /** Selects the CPU and features to generate code for
+     * @param cpu A CPU name or "native" to use the host CPU and its features
+     * @param features Comma separated, e.g. "+avx2,-fma" */
+    static void setTarget(std::string cpu, std::string features);
+    /** Records the target in every function so the optimizer can use it */
+    static void addTargetAttributes();
+    /** Sets up the target and a module holding the runtime declarations,
+     * independently of any program so that it can be done ahead of time */
+    static void prepareCompilation(const char *programName);
+    /** Compiles the program as a module with an initializer instead of main */
+    static void setModule(std::string name);
+    /** Makes function values {code, environment} pairs instead of trampolines,
+     * which need no executable heap */
+    static void setFatClosures(bool fat);
+    static bool usesFatClosures();
+    /** @param optLevel 0-3, as in -O0 to -O3 */
+    void start_compilation(const char *programName, int optLevel = 0);
+    /** The value of the definition a use is bound to, or for library functions and
+     * imports (definition is nullptr) of id, loaded from its module if imported (-use) */
+    static llvm::Value *lookupValue(Symbol id, LivenessEntry *definition);
+    static void runOptimizationPipeline(llvm::Module &M);
+    /** Moves the functions of fragments into objects of their own (-incremental),
+     * leaving declarations in TheModule */
+    static void compileFragments();
+    /** Runs main of the compiled module in-process and returns its exit code */
+    static int runInJIT();
+    static std::vector<std::pair<std::string, llvm::Function *>> *genLibGlueLogic();
     void printLLVMIR();
     void emitObjectCode(const char *filename);
+    void emitObjectCode(llvm::SmallVectorImpl<char> &buffer);
+    static void emitObjectCode(llvm::Module &M, llvm::SmallVectorImpl<char> &buffer);
     void emitAssemblyCode();
-    void checkTypeGraphs(TypeGraph *t1, TypeGraph *t2, std::function<void(void)> *errCallback);
+    /** Constrains t1 (given) to equal t2 (expected), failing with the message kind describes */
+    void checkTypeGraphs(TypeGraph *t1, TypeGraph *t2, ConstraintKind kind,
+                         const char *msg = nullptr, int index = 0);
+    void printConstraintError(const ConstraintContext &context);
     void printError(std::string msg, bool crash = true);
     virtual void insertToTable();
-    void insertBasicToSymbolTable(std::string id, TypeGraph *t);
-    void insertRefToSymbolTable(std::string id, TypeGraph *t);
-    void insertArrayToSymbolTable(std::string id, TypeGraph *contained_type, int d);
-    FunctionEntry *insertFunctionToSymbolTable(std::string id, TypeGraph *t);
-    void insertTypeToTypeTable(std::string id);
-    ConstructorEntry *insertConstructorToConstructorTable(std::string Id);
-    SymbolEntry *lookupBasicFromSymbolTable(std::string id);
-    ArrayEntry *lookupArrayFromSymbolTable(std::string id);
-    TypeEntry *lookupTypeFromTypeTable(std::string id);
-    ConstructorEntry *lookupConstructorFromContstructorTable(std::string Id);
+    SymbolEntry *insertBasicToSymbolTable(Symbol id, TypeGraph *t);
+    RefEntry *insertRefToSymbolTable(Symbol id, TypeGraph *t);
+    ArrayEntry *insertArrayToSymbolTable(Symbol id, TypeGraph *contained_type, int d);
+    FunctionEntry *insertFunctionToSymbolTable(Symbol id, TypeGraph *t);
+    void insertTypeToTypeTable(Symbol id);
+    ConstructorEntry *insertConstructorToConstructorTable(Symbol Id);
+    SymbolEntry *lookupBasicFromSymbolTable(Symbol id);
+    ArrayEntry *lookupArrayFromSymbolTable(Symbol id);
+    TypeEntry *lookupTypeFromTypeTable(Symbol id);
+    ConstructorEntry *lookupConstructorFromContstructorTable(Symbol Id);
+    /** @return The definition id is bound to in its scope, see resolve.cpp */
+    LivenessEntry *bindToDefinition(Symbol id);
+    /** @return The type of a use bound to definition, looked up in st
+     * only for library functions and imports (no definition) */
+    TypeGraph *lookupDefinitionTypeGraph(LivenessEntry *definition, Symbol id);
     void printIdTypeGraphs();
-    void addToIdList(std::string id);
+    void addToIdList(Symbol id);
 };
 
 std::ostream &operator<<(std::ostream &out, const AST &t);
@@ -220,10 +285,10 @@ public:
 class CustomType : public Type
 {
 private:
-    std::string id;
+    Symbol id;
 
 public:
-    CustomType(std::string *id);
+    CustomType(Symbol id);
     virtual TypeGraph *get_TypeGraph() override;
     virtual std::string getTypeStr() const override;
 };
@@ -238,9 +303,10 @@ protected:
 
 public:
     TypeGraph *get_TypeGraph();
-    void type_check(TypeGraph *t, std::string msg = "Type mismatch");
+    void type_check(TypeGraph *t, const char *msg = "Type mismatch",
+                    ConstraintKind kind = ConstraintKind::TypeCheck, int index = 0);
     void checkIntCharFloat(std::string msg = "Must be int, char or float");
-    friend void same_type(Expr *e1, Expr *e2, std::string msg);
+    friend void same_type(Expr *e1, Expr *e2, const char *msg);
 };
 
 /* Useful classes for definitions ***********************************/
@@ -248,11 +314,11 @@ public:
 class Constr : public AST
 {
 private:
-    std::string Id;
+    Symbol Id;
     std::vector<Type *> type_list;
 
 public:
-    Constr(std::string *Id, std::vector<Type *> *t);
+    Constr(Symbol Id, std::vector<Type *> *t);
     void add_Id_to_ct(TypeEntry *te);
     virtual llvm::Value *compile() override;
     virtual void printOn(std::ostream &out) const override;
@@ -261,14 +327,19 @@ public:
 class Par : public AST
 {
 private:
-    std::string id;
+    Symbol id;
     Type *T;
 
+    // Filled by resolve
+    LivenessEntry *entry = nullptr;
+
 public:
-    Par(std::string *id, Type *t = new UnknownType);
+    Par(Symbol id, Type *t = new UnknownType);
     virtual void insertToTable() override;
     TypeGraph *get_TypeGraph();
-    std::string getId();
+    Symbol getId();
+    void setEntry(LivenessEntry *e);
+    LivenessEntry *getEntry();
     virtual void printOn(std::ostream &out) const override;
 };
 
@@ -277,18 +348,18 @@ public:
 class DefStmt : public AST
 {
 protected:
-    std::string id;
+    Symbol id;
 
 public:
-    DefStmt(std::string id);
+    DefStmt(Symbol id);
     virtual bool isDef() const;
     virtual bool isFunctionDefinition() const;
     virtual void insertToTable();
-    virtual llvm::Value *generateTrampoline();
+    virtual llvm::Value *generateClosure();
     virtual void generateLLVMPrototype();
     virtual void processEnvBacklog();
     virtual void generateBody();
-    std::string getId();
+    Symbol getId();
     virtual TypeGraph *getTypeGraph();
 };
 class Tdef : public DefStmt
@@ -297,7 +368,7 @@ private:
     std::vector<Constr *> constr_list;
 
 public:
-    Tdef(std::string *id, std::vector<Constr *> *c);
+    Tdef(Symbol id, std::vector<Constr *> *c);
     virtual void insertToTable() override;
     virtual void sem() override;
     virtual llvm::Value *compile() override;
@@ -313,9 +384,14 @@ protected:
     // Useful for liveness
     TypeGraph *TG;
 
+    // Filled by resolve
+    LivenessEntry *entry = nullptr;
+
 public:
-    Def(std::string id, Type *t);
+    Def(Symbol id, Type *t);
     virtual bool isDef() const override;
+    void setEntry(LivenessEntry *e);
+    LivenessEntry *getEntry();
     Type *get_type();
     virtual TypeGraph *getTypeGraph() override;
 };
@@ -325,12 +401,13 @@ protected:
     Expr *expr;
 
 public:
-    Constant(std::string *id, Expr *e, Type *t = new UnknownType);
+    Constant(Symbol id, Expr *e, Type *t = new UnknownType);
     virtual void sem() override;
     virtual void insertToTable() override;
     // - if it is a true Constant definition stores the result of the expr->codegen()
     // - Danger if it's a copy of an already existing function or other edge cases
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
     virtual void printOn(std::ostream &out) const override;
 };
@@ -340,40 +417,79 @@ private:
     std::vector<Par *> par_list;
     //TypeGraph *TG;
 
-    // Filled in liveness useful for genIR
+    // Filled in resolve, the depth of the scope it is defined in
     int scope = 0;
-    std::map<std::string, LivenessEntry *> external = {};
+    // Filled in liveness useful for genIR
+    std::map<Symbol, LivenessEntry *, SymbolNameLess> external = {};
+    // Set in liveness if it is used as a value, not only called by name
+    bool escapes = false;
+    // Set in liveness if its body calls itself in tail position
+    bool selfTailCalls = false;
 
     // Filled in genIR
     llvm::Function *funcPrototype;
     llvm::StructType *envStructType;
-    std::vector<std::pair<AST *, llvm::Value *>> envBacklog = {};
+    // Self tail calls jump to tailRecurse, passing the new arguments to its phis
+    llvm::BasicBlock *tailRecurse = nullptr;
+    std::vector<llvm::PHINode *> tailRecurseArgs = {};
+    // Captured functions of the same letdef, whose closures follow this one's
+    std::vector<std::pair<LivenessEntry *, llvm::Value *>> envBacklog = {};
+
+    // Set for top-level functions when compiling incrementally
+    Fragment *fragment = nullptr;
+
+    llvm::Value *continueAfterReturn(llvm::Type *type);
 public:
-    Function(std::string *id, std::vector<Par *> *p, Expr *e, Type *t = new UnknownType);
+    Function(Symbol id, std::vector<Par *> *p, Expr *e, Type *t = new UnknownType);
     virtual void sem() override;
     virtual bool isFunctionDefinition() const override;
     virtual void insertToTable() override;
     // - Generates the function prototype
     // - creates a scope, inserts the parameter names and values
     // - calls expr->codegen()
-    llvm::Value *generateTrampoline() override;
+    /** Allocates and fills the environment, @return The value of the function:
+     * a trampoline if it escapes, otherwise the environment itself */
+    llvm::Value *generateClosure() override;
     void processEnvBacklog() override;
     void generateLLVMPrototype() override;
     void generateBody() override;
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
     void addExternal(LivenessEntry *l);
     friend void insertExternalToFrom(Function *funcDependent, Function *func);
-    std::map<std::string, LivenessEntry *> getExternal();
+    const std::map<Symbol, LivenessEntry *, SymbolNameLess> &getExternal();
     llvm::StructType* getEnvStructType();
+    /** @return The type ext is captured with, in the environment or as an argument */
+    llvm::Type *getCapturedType(LivenessEntry *ext);
+    void markEscaping();
+    bool isEscaping();
+    /** @return Whether it takes what it captures as arguments, instead of an
+     * environment: it does not escape, captures a few symbols and is only
+     * called by name from its own body and the scope it is defined in */
+    bool isLifted();
+    /** Calls the function itself, with env (its value) as the nest argument */
+    llvm::Value *createDirectCall(llvm::Value *env, std::vector<llvm::Value *> args);
+    /** Calls a lifted function, passing the values of what it captures */
+    llvm::Value *createLiftedCall(std::vector<llvm::Value *> args);
+    void markSelfTailCall();
+    /** Jumps back to the start of the body with args, instead of calling itself
+     * @return The value the rest of the body is generated with, never reached */
+    llvm::Value *createSelfTailCall(std::vector<llvm::Value *> args);
+    /** Returns the result of call, made in tail position of the body. The call
+     * is guaranteed to reuse the frame if callee (nullptr if unknown) is called
+     * directly and has the same signature and calling convention
+     * @return The value the rest of the body is generated with, never reached */
+    llvm::Value *createTailReturn(llvm::Value *call, Function *callee);
     void setScope(int s);
     int getScope();
+    void setFragment(Fragment *f);
     virtual void printOn(std::ostream &out) const override;
 };
 class Mutable : public Def
 {
 public:
-    Mutable(std::string id, Type *T = new UnknownType);
+    Mutable(Symbol id, Type *T = new UnknownType);
 };
 class Array : public Mutable
 {
@@ -381,7 +497,7 @@ private:
     std::vector<Expr *> expr_list;
 
 public:
-    Array(std::string *id, std::vector<Expr *> *e, Type *T = new UnknownType);
+    Array(Symbol id, std::vector<Expr *> *e, Type *T = new UnknownType);
     virtual void sem() override;
     int get_dimensions();
     virtual void insertToTable();
@@ -390,13 +506,14 @@ public:
     // these struct types contain a pointer to the contained type,
     // and the length of every dimension (could be done as independent fields, or in an array)
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
     virtual void printOn(std::ostream &out) const override;
 };
 class Variable : public Mutable
 {
 public:
-    Variable(std::string *id, Type *T = new UnknownType);
+    Variable(Symbol id, Type *T = new UnknownType);
     virtual void insertToTable() override;
     // alloca's the necessary space for a var of its TYPE
     virtual llvm::Value *compile() override;
@@ -416,11 +533,14 @@ private:
 
 public:
     Letdef(std::vector<DefStmt *> *d, bool rec = false);
+    std::vector<DefStmt *> &getDefList();
     virtual void sem() override;
     // in order compile the definitions contained
     // (recursive or not is irrelevant for functions if prototypes are defined at the start)
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
+    virtual void planFragment(std::string context, std::map<std::string, int> &ordinals) override;
     virtual void printOn(std::ostream &out) const override;
 };
 class Typedef : public Definition
@@ -451,7 +571,16 @@ public:
     void append(Definition *d);
     // in order compile all the contained definitions
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
+    /** Assigns link names to the top-level definitions and fingerprints
+     * the functions of each, looking their objects up in the fragment cache
+     * @param options Every code-affecting option, in a canonical form */
+    void planFragments(std::string options);
+    /** @return The top-level definitions a module exports, the last of each name */
+    std::vector<Def *> getExports();
+    /** Writes the interface of the module compiled to objectPath */
+    void writeInterface(std::string path, std::string objectPath);
     virtual void printOn(std::ostream &out) const override;
 };
 
@@ -468,7 +597,9 @@ public:
     virtual void sem() override;
     // open scope, do the definition, compile the expression, return its result Value*
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
+    virtual void markTailCalls(Function *f) override;
     virtual void printOn(std::ostream &out) const override;
 };
 
@@ -570,7 +701,9 @@ public:
     llvm::Value *allStructFieldsEqual(llvm::Value *lhsVal,
                                       llvm::Value *rhsVal);
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
+    virtual void markTailCalls(Function *f) override;
     virtual void printOn(std::ostream &out) const override;
 };
 class UnOp : public Expr
@@ -584,6 +717,7 @@ public:
     virtual void sem() override;
     // switch-case for every possible operator
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
     virtual void printOn(std::ostream &out) const override;
 };
@@ -611,22 +745,27 @@ public:
     // phi node may be necessary, avoidable if we can be sure
     // that the condition is "constant" (pointer dereference, or some shit)
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
     virtual void printOn(std::ostream &out) const override;
 };
 class For : public Expr
 {
 private:
-    std::string id;
+    Symbol id;
     std::string step;
     Expr *start, *finish, *body;
 
+    // Filled by resolve
+    LivenessEntry *entry = nullptr;
+
 public:
-    For(std::string *id, Expr *e1, std::string s, Expr *e2, Expr *e3);
-    std::string getId();
+    For(Symbol id, Expr *e1, std::string s, Expr *e2, Expr *e3);
+    Symbol getId();
     virtual void sem() override;
     // could possibly alloc a variable to use for the loop
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
     virtual void printOn(std::ostream &out) const override;
 };
@@ -641,7 +780,9 @@ public:
     // again think about phi nodes, otherwise its a simple if compilation,
     // noteworthy: no 'else' means else branch just jumps to end
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
+    virtual void markTailCalls(Function *f) override;
     virtual void printOn(std::ostream &out) const override;
 };
 
@@ -649,14 +790,18 @@ class Dim : public Expr
 {
 private:
     Int_literal *dim;
-    std::string id;
+    Symbol id;
+
+    // Filled by resolve, nullptr for library functions and imports
+    LivenessEntry *definition = nullptr;
 
 public:
-    Dim(std::string *id, Int_literal *dim = new Int_literal(1));
+    Dim(Symbol id, Int_literal *dim = new Int_literal(1));
     virtual void sem() override;
     // llvm may have our backs, may store some runtime (or at least the expression)
     // info about the length of an array (through its type system)
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
     virtual void printOn(std::ostream &out) const override;
 };
@@ -664,13 +809,17 @@ public:
 class ConstantCall : public Expr
 {
 protected:
-    std::string id;
+    Symbol id;
+
+    // Filled by resolve, nullptr for library functions and imports
+    LivenessEntry *definition = nullptr;
 
 public:
-    ConstantCall(std::string *id);
+    ConstantCall(Symbol id);
     virtual void sem() override;
     // lookup and return the Value* stored, special case if it's a function
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
     virtual void printOn(std::ostream &out) const override;
 };
@@ -679,45 +828,54 @@ class FunctionCall : public ConstantCall
 private:
     std::vector<Expr *> expr_list;
 
-    // Will be filled during liveness
-    Function *f;
+    // Will be filled during liveness, if the callee is a function definition
+    Function *f = nullptr;
+    // Set in liveness if it is in tail position of the body of tailOf
+    Function *tailOf = nullptr;
 
 public:
-    FunctionCall(std::string *id, std::vector<Expr *> *expr_list);
+    FunctionCall(Symbol id, std::vector<Expr *> *expr_list);
     virtual void sem() override;
     // get the function prototype and call it, return the Value* of the call
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
+    virtual void markTailCalls(Function *f) override;
     virtual void printOn(std::ostream &out) const override;
 };
 class ConstructorCall : public Expr
 {
 private:
-    std::string Id;
+    Symbol Id;
     std::vector<Expr *> expr_list;
     ConstructorTypeGraph *constructorTypeGraph = nullptr; // Is filled by sem
 
 public:
-    ConstructorCall(std::string *Id, std::vector<Expr *> *expr_list = new std::vector<Expr *>());
+    ConstructorCall(Symbol Id, std::vector<Expr *> *expr_list = new std::vector<Expr *>());
     virtual void sem() override;
     // creates a struct (emplaces it in the big struct sets the enum?)
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
     virtual void printOn(std::ostream &out) const override;
 };
 class ArrayAccess : public Expr
 {
 private:
-    std::string id;
+    Symbol id;
     std::vector<Expr *> expr_list;
 
+    // Filled by resolve, nullptr for library functions and imports
+    LivenessEntry *definition = nullptr;
+
 public:
-    ArrayAccess(std::string *id, std::vector<Expr *> *expr_list);
+    ArrayAccess(Symbol id, std::vector<Expr *> *expr_list);
     virtual void sem() override;
     // since inside the struct a simple array is contained,
     // perform the calculation of the actual address before dereferencing
     // (We could if we wanted to, check bounds at runtime and exit with error code)
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
     virtual void printOn(std::ostream &out) const override;
 };
@@ -751,33 +909,36 @@ public:
 class PatternId : public Pattern
 {
 protected:
-    std::string id;
+    Symbol id;
 
     // Will be filled by checkPatternTypeGraph
     TypeGraph *TG;
 
+    // Filled by resolve
+    LivenessEntry *entry = nullptr;
+
 public:
-    PatternId(std::string *id);
-    std::string getId();
+    PatternId(Symbol id);
+    Symbol getId();
     TypeGraph *getTypeGraph();
     virtual void checkPatternTypeGraph(TypeGraph *t) override;
     virtual llvm::Value *compile() override;
-    virtual void liveness(Function *prevFunc) override;
+    virtual void resolve() override;
     virtual void printOn(std::ostream &out) const override;
 };
 class PatternConstr : public Pattern
 {
 protected:
-    std::string Id;
+    Symbol Id;
     std::vector<Pattern *> pattern_list;
 
     // Will be filled by checkPatternTypeGraph
     ConstructorTypeGraph *constrTypeGraph;
 
 public:
-    PatternConstr(std::string *Id, std::vector<Pattern *> *p_list = new std::vector<Pattern *>());
+    PatternConstr(Symbol Id, std::vector<Pattern *> *p_list = new std::vector<Pattern *>());
     virtual void checkPatternTypeGraph(TypeGraph *t) override;
-    virtual void liveness(Function *prevFunc) override;
+    virtual void resolve() override;
     virtual llvm::Value *compile() override;
     virtual void printOn(std::ostream &out) const override;
 };
@@ -802,7 +963,9 @@ public:
     // For custom types check the enum to match the constructor call each time,
     // if it matches dereference once and check the inner values recursively
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
+    virtual void markTailCalls(Function *f) override;
     virtual void printOn(std::ostream &out) const override;
 };
 class Match : public Expr
@@ -816,12 +979,15 @@ public:
     virtual void sem() override;
     // generate code for each clause, return the value of its result
     virtual llvm::Value *compile() override;
+    virtual void resolve() override;
     virtual void liveness(Function *prevFunc) override;
+    virtual void markTailCalls(Function *f) override;
     virtual void printOn(std::ostream &out) const override;
 };
 
 /********************************************************************/
 
+/** The definition of a symbol, which resolve binds every use of it to */
 class LivenessEntry
 {
 protected:
@@ -831,12 +997,25 @@ protected:
     // has been added to the table
     bool visited = false;
 
+    // The type sem declares the symbol with, that its uses are checked against
+    TypeGraph *symbolTypeGraph = nullptr;
+
+    // Set in genIR, its value in the function being generated
+    llvm::Value *value = nullptr;
+
 public:
     LivenessEntry(int scope);
+    /** Entries live as long as the nodes they point to */
+    static void *operator new(std::size_t size) { return astArena().allocate(size); }
+    static void operator delete(void *) {}
     int getScope();
     void visit();
     bool isVisited();
-    virtual std::string getId() = 0;
+    void setSymbolTypeGraph(TypeGraph *t);
+    TypeGraph *getSymbolTypeGraph();
+    void setValue(llvm::Value *v);
+    llvm::Value *getValue();
+    virtual Symbol getId() = 0;
     virtual TypeGraph *getTypeGraph() = 0;
     virtual AST *getNode() = 0;
 };
@@ -849,7 +1028,7 @@ protected:
 public:
     LivenessEntryDef(int scope, Def *symbolDef);
     virtual Def *getNode() override;
-    virtual std::string getId() override;
+    virtual Symbol getId() override;
     virtual TypeGraph *getTypeGraph() override;
 };
 class LivenessEntryPar
@@ -861,7 +1040,7 @@ protected:
 public:
     LivenessEntryPar(int scope, Par *symbolPar);
     virtual Par *getNode() override;
-    virtual std::string getId() override;
+    virtual Symbol getId() override;
     virtual TypeGraph *getTypeGraph() override;
 };
 class LivenessEntryFor
@@ -873,7 +1052,7 @@ protected:
 public: 
     LivenessEntryFor(int scope, For *symbolFor);
     virtual For *getNode() override;
-    virtual std::string getId() override;
+    virtual Symbol getId() override;
     virtual TypeGraph *getTypeGraph() override;
 };
 class LivenessEntryPatternId
@@ -885,6 +1064,6 @@ protected:
 public:
     LivenessEntryPatternId(int scope, PatternId *symbolPatternId);
     virtual PatternId *getNode() override;
-    virtual std::string getId() override;
+    virtual Symbol getId() override;
     virtual TypeGraph *getTypeGraph() override;
 };
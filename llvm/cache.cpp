@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <dirent.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/SHA1.h>
+
+#include "cache.hpp"
+
+CompileCache compileCache;
+
+static bool copyFile(std::string from, std::string to)
+{
+    std::ifstream in(from, std::ios::binary);
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    if (!in || !out)
+        return false;
+    out << in.rdbuf();
+    out.close();
+    struct stat st;
+    if (out.fail() || stat(from.c_str(), &st))
+        return false;
+    chmod(to.c_str(), st.st_mode & 0777);
+    return true;
+}
+
+static void makeDirectories(std::string path)
+{
+    for (std::size_t i = 1; i <= path.size(); i++)
+        if (i == path.size() || path[i] == '/')
+            mkdir(path.substr(0, i).c_str(), 0755);
+}
+
+std::string CompileCache::defaultDir()
+{
+    if (const char *dir = std::getenv("LLAMAC_CACHE_DIR"))
+        return dir;
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"))
+        return std::string(xdg) + "/llamac";
+    const char *home = std::getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/.cache/llamac";
+}
+std::string CompileCache::entryPath(std::string key)
+{
+    return dir + "/" + key;
+}
+void CompileCache::enable(std::string dir, unsigned long long maxBytes)
+{
+    enabled = true;
+    this->dir = dir;
+    this->maxBytes = maxBytes;
+    makeDirectories(dir);
+}
+bool CompileCache::isEnabled()
+{
+    return enabled;
+}
+
+void CompileCache::countLookup(bool hit)
+{
+    // Several llamac processes may share the directory
+    std::string statsPath = dir + "/stats";
+    int fd = open(statsPath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1)
+        return;
+    flock(fd, LOCK_EX);
+    char buf[128] = {0};
+    unsigned long long hits = 0, misses = 0;
+    if (read(fd, buf, sizeof(buf) - 1) > 0)
+        std::sscanf(buf, "%llu %llu", &hits, &misses);
+    (hit ? hits : misses)++;
+    std::string updated = std::to_string(hits) + " " + std::to_string(misses) + "\n";
+    if (ftruncate(fd, 0) == 0 && pwrite(fd, updated.data(), updated.size(), 0) < 0)
+        std::cerr << "Couldn't update cache statistics" << std::endl;
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+bool CompileCache::fetch(llvm::StringRef source, std::string options, std::string output)
+{
+    std::string key = CompileCache::key(options + "\n" + source.str());
+    std::string entry = lookup(key);
+    if (entry != "" && copyFile(entry, output))
+        return true;
+    pendingKey = key;
+    return false;
+}
+
+std::string CompileCache::fileDigest(std::string path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return "missing";
+    llvm::SHA1 hasher;
+    std::vector<char> buf(1 << 16);
+    while (in.read(buf.data(), buf.size()) || in.gcount() > 0)
+        hasher.update(llvm::StringRef(buf.data(), in.gcount()));
+    return llvm::toHex(hasher.final(), true);
+}
+
+// Looks for the build-id note the linker put in the executable
+static int findBuildId(struct dl_phdr_info *info, size_t size, void *data)
+{
+    std::string *id = (std::string *)data;
+    for (int i = 0; i < info->dlpi_phnum; i++)
+    {
+        const ElfW(Phdr) &ph = info->dlpi_phdr[i];
+        if (ph.p_type != PT_NOTE)
+            continue;
+        const char *note = (const char *)(info->dlpi_addr + ph.p_vaddr), *end = note + ph.p_memsz;
+        while (note + sizeof(ElfW(Nhdr)) <= end)
+        {
+            const ElfW(Nhdr) *header = (const ElfW(Nhdr) *)note;
+            const char *name = note + sizeof(ElfW(Nhdr));
+            const char *desc = name + ((header->n_namesz + 3) & ~3);
+            if (header->n_type == NT_GNU_BUILD_ID && header->n_namesz == 4 && std::memcmp(name, "GNU", 4) == 0)
+            {
+                *id = llvm::toHex(llvm::StringRef(desc, header->n_descsz), true);
+                return 1;
+            }
+            note = desc + ((header->n_descsz + 3) & ~3);
+        }
+    }
+    // The executable is visited first, the shared objects don't matter
+    return 1;
+}
+
+// Identifies the build of llamac, so that rebuilding any part of it (or
+// linking another LLVM) never reuses what the previous build produced
+static const std::string &compilerIdentity()
+{
+    static const std::string identity = [] {
+        std::string id = "";
+        dl_iterate_phdr(findBuildId, &id);
+        // Without a build-id the executable itself is hashed
+        if (id == "")
+            id = CompileCache::fileDigest("/proc/self/exe");
+        return std::string(LLAMAC_VERSION " LLVM " LLVM_VERSION_STRING " ") + id + "\n";
+    }();
+    return identity;
+}
+
+std::string CompileCache::key(std::string contents)
+{
+    llvm::SHA1 hasher;
+    hasher.update(compilerIdentity());
+    hasher.update(contents);
+    return llvm::toHex(hasher.final(), true);
+}
+
+std::string CompileCache::lookup(std::string key)
+{
+    std::string entry = entryPath(key);
+    if (access(entry.c_str(), R_OK) == 0)
+    {
+        // The modification time orders entries for eviction
+        utime(entry.c_str(), nullptr);
+        countLookup(true);
+        return entry;
+    }
+    countLookup(false);
+    return "";
+}
+
+void CompileCache::store(std::string artifact)
+{
+    if (!enabled || pendingKey == "")
+        return;
+    // Written aside and renamed so that readers never see partial entries
+    std::string entry = entryPath(pendingKey), tmp = entry + ".tmp" + std::to_string(getpid());
+    if (copyFile(artifact, tmp))
+        std::rename(tmp.c_str(), entry.c_str());
+    else
+        std::remove(tmp.c_str());
+    pendingKey = "";
+    evict();
+}
+
+std::string CompileCache::insert(std::string key, llvm::ArrayRef<char> contents)
+{
+    std::string entry = entryPath(key), tmp = entry + ".tmp" + std::to_string(getpid());
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out.write(contents.data(), contents.size());
+    out.close();
+    if (out.fail() || std::rename(tmp.c_str(), entry.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        return "";
+    }
+    return entry;
+}
+
+void CompileCache::evict()
+{
+    struct Entry
+    {
+        std::string path;
+        unsigned long long size;
+        time_t used;
+    };
+    std::vector<Entry> entries;
+    unsigned long long total = 0;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    while (struct dirent *e = readdir(d))
+    {
+        std::string name = e->d_name;
+        if (name.size() != 40) // only SHA1 named entries
+            continue;
+        struct stat st;
+        std::string path = entryPath(name);
+        if (stat(path.c_str(), &st) == 0)
+        {
+            entries.push_back({path, (unsigned long long)st.st_size, st.st_mtime});
+            total += st.st_size;
+        }
+    }
+    closedir(d);
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) { return a.used < b.used; });
+    for (auto &e : entries)
+    {
+        if (total <= maxBytes)
+            break;
+        if (std::remove(e.path.c_str()) == 0)
+            total -= e.size;
+    }
+}
+
+void CompileCache::printStats(std::ostream &out)
+{
+    unsigned long long hits = 0, misses = 0, entries = 0, total = 0;
+    std::ifstream stats(dir + "/stats");
+    stats >> hits >> misses;
+    if (DIR *d = opendir(dir.c_str()))
+    {
+        while (struct dirent *e = readdir(d))
+        {
+            struct stat st;
+            if (std::string(e->d_name).size() == 40 && stat(entryPath(e->d_name).c_str(), &st) == 0)
+            {
+                entries++;
+                total += st.st_size;
+            }
+        }
+        closedir(d);
+    }
+    out << "Cache directory: " << dir << std::endl
+        << "Hits:            " << hits << std::endl
+        << "Misses:          " << misses << std::endl
+        << "Entries:         " << entries << std::endl
+        << "Size:            " << total / 1024 << " KB of " << maxBytes / 1024 << " KB" << std::endl;
+}
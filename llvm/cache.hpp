@@ -0,0 +1,48 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+#define LLAMAC_VERSION "1.1"
+
+/** Content-addressed cache of compiled artifacts (executables and object
+ * files) keyed by the source, the build of the compiler and every option that
+ * affects the generated code. Least recently used entries are evicted
+ * once the cache grows past its size bound */
+class CompileCache
+{
+    bool enabled = false;
+    std::string dir;
+    unsigned long long maxBytes;
+    // Key of the artifact the current compilation will produce (on a miss)
+    std::string pendingKey = "";
+
+    std::string entryPath(std::string key);
+    void countLookup(bool hit);
+
+public:
+    static std::string defaultDir();
+    /** Hashes contents together with the build of the compiler into an entry key */
+    static std::string key(std::string contents);
+    /** @return The hash of the contents of a file, "missing" if it can't be read */
+    static std::string fileDigest(std::string path);
+    void enable(std::string dir, unsigned long long maxBytes);
+    bool isEnabled();
+    /** Copies the cached artifact of this compilation to output if present
+     * @param options Every code-affecting option, in a canonical form */
+    bool fetch(llvm::StringRef source, std::string options, std::string output);
+    /** Adds the artifact produced after a miss in fetch */
+    void store(std::string artifact);
+    /** @return The path of the entry with this key, "" if it isn't cached */
+    std::string lookup(std::string key);
+    /** Adds an entry with the given contents, without evicting others
+     * @return The path of the new entry, "" if it couldn't be written */
+    std::string insert(std::string key, llvm::ArrayRef<char> contents);
+    /** Removes least recently used entries until the size bound holds */
+    void evict();
+    void printStats(std::ostream &out);
+};
+
+extern CompileCache compileCache;
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <iterator>
+#include <climits>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.hpp"
+
+/* Thin stand-in for llamac that forwards its arguments to a running
+ * llamac -serve. Use - as the input file to send the source from stdin */
+int main(int argc, char **argv)
+{
+    std::string socketPath = defaultSocketPath();
+    CompileRequest req;
+    req.args.push_back("llamac");
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "-socket" && i + 1 < argc)
+            socketPath = argv[++i];
+        else
+            req.args.push_back(argv[i]);
+    }
+    if (req.args.size() > 1 && req.args[1] == "-")
+        req.source.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)))
+        req.cwd = cwd;
+
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        std::cerr << "Couldn't connect to llamac server at " << socketPath << std::endl;
+        return 1;
+    }
+
+    CompileResponse res;
+    if (!sendRequest(sock, req) || !recvResponse(sock, res))
+    {
+        std::cerr << "Lost connection to llamac server" << std::endl;
+        return 1;
+    }
+    close(sock);
+
+    std::cout << res.out;
+    std::cerr << res.err;
+    return res.status;
+}
@@ -9,16 +9,25 @@
 #include <llvm/Transforms/InstCombine/InstCombine.h>
 #include <llvm/Transforms/Utils.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Passes/PassBuilder.h>
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/MC/SubtargetFeature.h"
 //#include "lexer.hpp" // to get extern yylineno and not crash from ast include
 #include "ast.hpp"
 #include "infer.hpp"
 #include "parser.hpp"
+#include "timing.hpp"
+#include "incremental.hpp"
+#include "interface.hpp"
+#include "scopedtable.hpp"
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
 #include <utility> // std::pair, std::make_pair
@@ -27,68 +36,12 @@
 /**        Symbol-Tables         */
 /*********************************/
 
-/** @param T is the Type the table will will hold pointers of */
-template <class T>
-class LLTable
-{
-    std::vector<std::map<std::string, T> *> *table;
-    bool nameInScope(std::string name, std::map<std::string, T> *scope)
-    {
-        return (scope->find(name) != scope->end());
-    }
+// Library functions and the exports of used modules, the values of the
+// program's own definitions are kept in the entries uses are bound to
+ScopedTable<llvm::Value *> LLValues;
 
-public:
-    LLTable() : table(new std::vector<std::map<std::string, T> *>())
-    {
-        openScope(); // open first (global) scope
-    }
-    /** Can be called with the implicit pair constructor
-     * e.g.: insert({"a_name", a_pointer})
-    */
-    void insert(std::pair<std::string, T> entry)
-    {
-        (*table->back())[entry.first] = entry.second;
-    }
-    T operator[](std::string name)
-    {
-        for (auto it = table->rbegin(); it != table->rend(); it++)
-        {
-            if (nameInScope(name, *it))
-                return (**it)[name];
-        }
-        return nullptr;
-    }
-    void openScope()
-    {
-        table->push_back(new std::map<std::string, T>());
-    }
-    void closeScope()
-    {
-        if (table->size() != 0)
-        {
-            std::map<std::string, T> *poppedScope = table->back();
-            table->pop_back();
-            delete poppedScope;
-        }
-    }
-    int getCurrScope()
-    {
-        return (table->size() - 1);
-    }
-    int getScopeOf(std::string name)
-    {
-        int scope = getCurrScope();
-        for (auto it = table->rbegin(); it != table->rend(); it++)
-        {
-            scope--;
-            if (nameInScope(name, *it))
-                break;
-        }
-        return scope;
-    }
-    ~LLTable() {}
-};
-LLTable<llvm::Value *> LLValues;
+// Globals of the used modules (-use), their values are loaded at every use
+std::set<llvm::Value *> importedValues;
 
 /*
 // Keeps track of the scope of the function inside which we are writing
@@ -106,14 +59,6 @@ llvm::Value *accessSymbolOrMakeGlobal(std::string name)
 }
 */
 
-void openScopeOfAll()
-{
-    LLValues.openScope();
-}
-void closeScopeOfAll()
-{
-    LLValues.closeScope();
-}
 
 
 /*********************************/
@@ -174,7 +119,6 @@ llvm::Value *getGlobalString(std::string s, llvm::IRBuilder<> Builder)
 llvm::LLVMContext AST::TheContext;
 llvm::IRBuilder<> AST::Builder(AST::TheContext);
 llvm::Module *AST::TheModule;
-llvm::legacy::FunctionPassManager *AST::TheFPM;
 
 llvm::TargetMachine *AST::TargetMachine;
 
@@ -189,26 +133,13 @@ llvm::Type *AST::arrCharType;
 llvm::Function *AST::TheMalloc;
 llvm::Function *AST::TheUncollectableMalloc;
 
-void AST::start_compilation(const char *programName, bool optimize)
+bool AST::prepared = false;
+std::string AST::targetCPU = "generic";
+std::string AST::targetFeatures = "";
+
+void AST::createTargetMachine()
 {
-    TheModule = new llvm::Module(programName, TheContext);
-    TheFPM = new llvm::legacy::FunctionPassManager(TheModule);
-    if (optimize)
-    {
-        TheFPM->add(llvm::createPromoteMemoryToRegisterPass());
-        TheFPM->add(llvm::createInstructionCombiningPass());
-        TheFPM->add(llvm::createReassociatePass());
-        TheFPM->add(llvm::createGVNPass());
-        TheFPM->add(llvm::createCFGSimplificationPass());
-    }
-    TheFPM->doInitialization();
-    // Emit object code initializations
     auto TargetTriple = llvm::sys::getDefaultTargetTriple();
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
     std::string Error;
     auto Target = llvm::TargetRegistry::lookupTarget(TargetTriple, Error);
     if (!Target)
@@ -216,11 +147,58 @@ void AST::start_compilation(const char *programName, bool optimize)
         llvm::errs() << Error;
         exit(1);
     }
-    auto CPU = "generic";
-    auto Features = "";
     llvm::TargetOptions opt;
     auto RM = llvm::Optional<llvm::Reloc::Model>();
-    TargetMachine = Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM);
+    TargetMachine = Target->createTargetMachine(TargetTriple, targetCPU, targetFeatures, opt, RM);
+}
+
+void AST::setTarget(std::string cpu, std::string features)
+{
+    if (cpu == "native")
+    {
+        cpu = llvm::sys::getHostCPUName().str();
+        llvm::StringMap<bool> hostFeatures;
+        if (llvm::sys::getHostCPUFeatures(hostFeatures))
+        {
+            llvm::SubtargetFeatures hostFeatureList;
+            for (auto &feature : hostFeatures)
+                hostFeatureList.AddFeature(feature.first(), feature.second);
+            // Explicit -mattr features come last so that they take precedence
+            features = hostFeatureList.getString() + (features == "" ? "" : "," + features);
+        }
+    }
+    if (cpu == targetCPU && features == targetFeatures)
+        return;
+    targetCPU = cpu;
+    targetFeatures = features;
+    // The compile server may have created one for the defaults already
+    if (TargetMachine)
+        createTargetMachine();
+}
+
+void AST::addTargetAttributes()
+{
+    for (auto &F : *TheModule)
+    {
+        if (F.isDeclaration())
+            continue;
+        F.addFnAttr("target-cpu", targetCPU);
+        if (targetFeatures != "")
+            F.addFnAttr("target-features", targetFeatures);
+    }
+}
+
+void AST::prepareCompilation(const char *programName)
+{
+    TheModule = new llvm::Module(programName, TheContext);
+    // Emit object code initializations
+    auto TargetTriple = llvm::sys::getDefaultTargetTriple();
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmParsers();
+    llvm::InitializeAllAsmPrinters();
+    createTargetMachine();
     TheModule->setDataLayout(TargetMachine->createDataLayout());
     TheModule->setTargetTriple(TargetTriple);
     // Basic types initializations start
@@ -230,7 +208,7 @@ void AST::start_compilation(const char *programName, bool optimize)
     flt = type_float->getLLVMType(TheModule);
     unitType = type_unit->getLLVMType(TheModule);
     machinePtrType = llvm::Type::getIntNTy(TheContext, TheModule->getDataLayout().getMaxPointerSizeInBits());
-    arrCharType = (new ArrayTypeGraph(1, new RefTypeGraph(type_char)))->getLLVMType(TheModule);
+    arrCharType = typeContext().getArray(1, typeContext().getRef(type_char))->getLLVMType(TheModule);
     // Initialize runtime lib functions
     std::vector<std::pair<std::string, llvm::Function *>> *libFunctions = genLibGlueLogic();
     for (auto &libFunc : *libFunctions)
@@ -247,19 +225,91 @@ void AST::start_compilation(const char *programName, bool optimize)
     llvm::FunctionType *gcFreeType = llvm::FunctionType::get(llvm::Type::getVoidTy(TheContext), {i8->getPointerTo()}, false);
     llvm::Function::Create(gcFreeType, llvm::Function::ExternalLinkage,
                            "GC_free", TheModule);
-    // Initialize main function (entry point)
 #else
     TheMalloc = TheUncollectableMalloc = nullptr;
 #endif // LIBGC
-    llvm::FunctionType *main_type = llvm::FunctionType::get(i32, {}, false);
-    llvm::Function *main =
-        llvm::Function::Create(main_type, llvm::Function::ExternalLinkage,
-                               "main", TheModule);
-    llvm::BasicBlock *BB = llvm::BasicBlock::Create(TheContext, "entry", main);
-    Builder.SetInsertPoint(BB);
+    prepared = true;
+}
+
+int AST::optimizationLevel = 0;
+bool AST::incremental = false;
+std::string AST::moduleName = "";
+bool AST::fatClosures = false;
+
+void AST::setModule(std::string name)
+{
+    moduleName = name;
+}
+void AST::setFatClosures(bool fat)
+{
+    fatClosures = fat;
+}
+bool AST::usesFatClosures()
+{
+    return fatClosures;
+}
+
+void AST::start_compilation(const char *programName, int optLevel)
+{
+    // The compile server has already done this before forking
+    if (!prepared)
+        prepareCompilation(programName);
+    optimizationLevel = optLevel;
+    static const llvm::CodeGenOpt::Level codeGenLevels[] = {
+        llvm::CodeGenOpt::None, llvm::CodeGenOpt::Less,
+        llvm::CodeGenOpt::Default, llvm::CodeGenOpt::Aggressive};
+    TargetMachine->setOptLevel(codeGenLevels[optimizationLevel]);
+    if (moduleName == "")
+    {
+        // Initialize main function (entry point)
+        llvm::FunctionType *main_type = llvm::FunctionType::get(i32, {}, false);
+        llvm::Function *main =
+            llvm::Function::Create(main_type, llvm::Function::ExternalLinkage,
+                                   "main", TheModule);
+        llvm::BasicBlock *BB = llvm::BasicBlock::Create(TheContext, "entry", main);
+        Builder.SetInsertPoint(BB);
+    }
+    else
+    {
+        // A module runs its top-level code in an initializer instead,
+        // at most once however many modules use it
+        llvm::FunctionType *init_type = llvm::FunctionType::get(llvm::Type::getVoidTy(TheContext), {}, false);
+        llvm::Function *init =
+            llvm::Function::Create(init_type, llvm::Function::ExternalLinkage,
+                                   moduleName + ".init", TheModule);
+        auto *initialized = new llvm::GlobalVariable(
+            *TheModule, i1, false, llvm::GlobalValue::InternalLinkage, c1(false),
+            moduleName + ".initialized");
+        llvm::BasicBlock *BB = llvm::BasicBlock::Create(TheContext, "entry", init),
+                         *DoneBB = llvm::BasicBlock::Create(TheContext, "done", init),
+                         *RunBB = llvm::BasicBlock::Create(TheContext, "run", init);
+        Builder.SetInsertPoint(BB);
+        Builder.CreateCondBr(Builder.CreateLoad(initialized), DoneBB, RunBB);
+        Builder.SetInsertPoint(DoneBB);
+        Builder.CreateRetVoid();
+        Builder.SetInsertPoint(RunBB);
+        Builder.CreateStore(c1(true), initialized);
+    }
+    // Used modules are initialized first and their exports bound to their globals
+    for (auto *m : usedModules)
+    {
+        llvm::FunctionType *init_type = llvm::FunctionType::get(llvm::Type::getVoidTy(TheContext), {}, false);
+        Builder.CreateCall(TheModule->getOrInsertFunction(m->name + ".init", init_type));
+        for (auto &e : m->exports)
+        {
+            auto *imported = new llvm::GlobalVariable(
+                *TheModule, e.type->getLLVMType(TheModule), false,
+                llvm::GlobalValue::ExternalLinkage, nullptr, m->name + "." + e.id);
+            LLValues.insert({e.id, imported});
+            importedValues.insert(imported);
+        }
+    }
     // compile the program code
     compile();
-    Builder.CreateRet(c32(0));
+    if (moduleName == "")
+        Builder.CreateRet(c32(0));
+    else
+        Builder.CreateRetVoid();
 
     bool bad = llvm::verifyModule(*TheModule, &llvm::errs());
     if (bad)
@@ -268,7 +318,46 @@ void AST::start_compilation(const char *programName, bool optimize)
         TheModule->print(llvm::errs(), nullptr);
         std::exit(1);
     }
-    TheFPM->run(*main);
+    addTargetAttributes();
+    if (incremental)
+    {
+        phaseTimer.start("fragments");
+        compileFragments();
+        phaseTimer.stop();
+    }
+    phaseTimer.start("llvm-passes");
+    runOptimizationPipeline(*TheModule);
+    phaseTimer.stop();
+}
+
+void AST::runOptimizationPipeline(llvm::Module &M)
+{
+    if (optimizationLevel == 0)
+        return;
+    static const llvm::PassBuilder::OptimizationLevel levels[] = {
+        llvm::PassBuilder::OptimizationLevel::O0, llvm::PassBuilder::OptimizationLevel::O1,
+        llvm::PassBuilder::OptimizationLevel::O2, llvm::PassBuilder::OptimizationLevel::O3};
+
+    // The vectorizers are off by default in the tuning options
+    llvm::PipelineTuningOptions PTO;
+    PTO.LoopVectorization = optimizationLevel >= 2;
+    PTO.SLPVectorization = optimizationLevel >= 2;
+    PTO.LoopInterleaving = optimizationLevel >= 2;
+    llvm::PassBuilder PB(TargetMachine, PTO);
+
+    llvm::LoopAnalysisManager LAM;
+    llvm::FunctionAnalysisManager FAM;
+    llvm::CGSCCAnalysisManager CGAM;
+    llvm::ModuleAnalysisManager MAM;
+    FAM.registerPass([&] { return PB.buildDefaultAAPipeline(); });
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    llvm::ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(levels[optimizationLevel]);
+    MPM.run(M, MAM);
 }
 void AST::printLLVMIR()
 {
@@ -297,6 +386,25 @@ void AST::emitObjectCode(const char *filename)
     pass.run(*TheModule);
     dst.flush();
 }
+void AST::emitObjectCode(llvm::SmallVectorImpl<char> &buffer)
+{
+    emitObjectCode(*TheModule, buffer);
+}
+void AST::emitObjectCode(llvm::Module &M, llvm::SmallVectorImpl<char> &buffer)
+{
+    llvm::raw_svector_ostream dst(buffer);
+
+    llvm::legacy::PassManager pass;
+    auto FileType = llvm::CGFT_ObjectFile;
+
+    if (TargetMachine->addPassesToEmitFile(pass, dst, nullptr, FileType))
+    {
+        llvm::errs() << "TargetMachine can't emit a file of this type";
+        exit(1);
+    }
+
+    pass.run(M);
+}
 void AST::emitAssemblyCode()
 {
     llvm::legacy::PassManager pass;
@@ -311,26 +419,13 @@ void AST::emitAssemblyCode()
     llvm::outs().flush();
 }
 
-llvm::Value *AST::getGlobalLiveValue() {
-    return globalLiveValue;
-}
-
-llvm::Value* AST::updateGlobalValue(llvm::Value *newVal) {
-    if (listOfFunctionsThatNeedSymbol.empty())
-        return nullptr;
-    if (!globalLiveValue) {
-        auto initializer = llvm::ConstantAggregateZero::get(newVal->getType());
-        globalLiveValue = new llvm::GlobalVariable(
-            *TheModule,
-            newVal->getType(),
-            false,
-            llvm::GlobalValue::InternalLinkage,
-            initializer
-        );
-    }
-    auto prevGlobal = Builder.CreateLoad(globalLiveValue, "reminder");
-    Builder.CreateStore(newVal, globalLiveValue);
-    return prevGlobal;
+llvm::Value *AST::lookupValue(Symbol id, LivenessEntry *definition) {
+    if (definition)
+        return definition->getValue();
+    llvm::Value *val = LLValues[id];
+    if (importedValues.find(val) != importedValues.end())
+        return Builder.CreateLoad(val, id.str());
+    return val;
 }
 
 /*********************************/
@@ -362,9 +457,8 @@ llvm::Value *Constant::compile()
     // std::cerr << std::endl;
 
     llvm::Value *exprVal = expr->compile();
-    exprVal->setName(id);
-    LLValues.insert({id, exprVal});
-    updateGlobalValue(exprVal);
+    exprVal->setName(id.str());
+    entry->setValue(exprVal);
     return nullptr;
 }
 
@@ -373,14 +467,22 @@ llvm::StructType *Function::getEnvStructType()
     if (envStructType)
         return envStructType;
     std::string envTypeName = getId() + ".env";
-    ConstructorTypeGraph *utilGraph = new ConstructorTypeGraph(envTypeName);
+    std::vector<llvm::Type *> fieldTypes;
     for (const auto &ext: external) {
-        utilGraph->addField(ext.second->getTypeGraph());
+        fieldTypes.push_back(getCapturedType(ext.second));
     }
-    envStructType = utilGraph->getLLVMType(TheModule);
-    envStructType->setName(envTypeName);
+    envStructType = llvm::StructType::create(TheContext, fieldTypes, envTypeName);
     return envStructType;
 }
+llvm::Type *Function::getCapturedType(LivenessEntry *ext)
+{
+    Function *func = dynamic_cast<Function *>(ext->getNode());
+    if (func && !func->isEscaping()) {
+        // the value of a function without trampoline is its environment
+        return i8->getPointerTo();
+    }
+    return ext->getTypeGraph()->getLLVMType(TheModule);
+}
 
 void DefStmt::generateLLVMPrototype() {
     std::cerr << "generateLLVMPrototype called for DefStmt\n";
@@ -400,20 +502,57 @@ void Function::generateLLVMPrototype()
     
     auto paramTypes = getTypeGraph()->getLLVMParamTypes(TheModule);
     auto resType = getTypeGraph()->getLLVMResultType(TheModule);
-    paramTypes.push_back(getEnvStructType()->getPointerTo());
+    if (isLifted()) {
+        // what it captures follows the parameters, there is no environment
+        for (const auto &ext: external) {
+            if (ext.second != entry)
+                paramTypes.push_back(getCapturedType(ext.second));
+        }
+    } else {
+        // Opaque, so that functions of the same type have the same signature
+        // and may call each other in guaranteed tail calls
+        paramTypes.push_back(i8->getPointerTo());
+    }
 
     auto newFuncType = llvm::FunctionType::get(resType, paramTypes, false);
-    funcPrototype = llvm::Function::Create(
-        newFuncType, llvm::Function::ExternalLinkage, id, TheModule
-    );
+    if (linkName != "")
+    {
+        // Top-level function of a fragment, defined in an object of its own
+        funcPrototype = llvm::Function::Create(
+            newFuncType, llvm::Function::ExternalLinkage, linkName, TheModule);
+        funcPrototype->setVisibility(llvm::GlobalValue::HiddenVisibility);
+        if (fragment)
+            fragment->functions.push_back(funcPrototype);
+    }
+    else
+    {
+        // Internal linkage lets the inliner and IPO passes see every caller
+        funcPrototype = llvm::Function::Create(
+            newFuncType, 
+            optimizationLevel >= 2 || incremental || moduleName != "" ?
+                llvm::Function::InternalLinkage : llvm::Function::ExternalLinkage,
+            id.str(), TheModule
+        );
+        // Trampolines and closures are called with the C calling convention,
+        // calls by name are all generated here
+        if (!isEscaping())
+            funcPrototype->setCallingConv(llvm::CallingConv::Fast);
+    }
+    // trampolines pass the environment in the nest register
+    if (!fatClosures && !isLifted())
+        funcPrototype->getArg(par_list.size())->addAttr(llvm::Attribute::Nest);
 }
 
-llvm::Value *DefStmt::generateTrampoline() {
-    std::cerr << "generateTrampoline() called for DefStmt\n";
+llvm::Value *DefStmt::generateClosure() {
+    std::cerr << "generateClosure() called for DefStmt\n";
     exit(1);
 }
-llvm::Value *Function::generateTrampoline()
+llvm::Value *Function::generateClosure()
 {
+    // Only called by name, with what it captures
+    if (isLifted())
+        return nullptr;
+
     auto trampolineEnvMallocInst =
         llvm::CallInst::CreateMalloc(Builder.GetInsertBlock(),
             machinePtrType, getEnvStructType(),
@@ -421,36 +560,49 @@ llvm::Value *Function::generateTrampoline()
             TheMalloc);
     auto trampolineEnvMalloc = 
         Builder.Insert(trampolineEnvMallocInst, getId() + ".envmalloc");
-
-    //TODO(ORF): Find out how much to allocate for the trampoline
-    auto trampolineMallocSize = c32(16);
-    auto trampolineMallocInst = 
-        llvm::CallInst::CreateMalloc(Builder.GetInsertBlock(),
-            machinePtrType, i8, 
-            llvm::ConstantExpr::getSizeOf(i8), trampolineMallocSize,
-            TheMalloc);
-    auto trampolineMalloc = 
-        Builder.Insert(trampolineMallocInst, getId() + ".trampmalloc");
     
     // fill the env struct
     int i = 0;
     llvm::Value *currEnvLoc;
-    AST *currDepNode;
     for (const auto &ext: external) {
         currEnvLoc = Builder.CreateGEP(
             trampolineEnvMalloc, {c32(0), c32(i)}, "tramp.currenvloc");
-        currDepNode = ext.second->getNode();
         if (inf.deepSubstitute(ext.second->getTypeGraph())->isFunction()) {
-            // save a backlog of global-structloc pairs to be
+            // save a backlog of entry-structloc pairs to be
             // processed after trampoline creations for mutually recursive functions
-            envBacklog.push_back({currDepNode, currEnvLoc});
+            envBacklog.push_back({ext.second, currEnvLoc});
         } else {
-            auto currDepVal = Builder.CreateLoad(
-                currDepNode->getGlobalLiveValue(), "loadedglobaltmp");
-            Builder.CreateStore(currDepVal, currEnvLoc, false);
+            // liveness captures it in every function between, so it is at hand
+            Builder.CreateStore(ext.second->getValue(), currEnvLoc, false);
         }
         i++;
     }
+
+    // Calls by name pass the environment to funcPrototype themselves
+    if (!isEscaping()) {
+        return Builder.CreatePointerCast(
+            trampolineEnvMalloc, i8->getPointerTo(), "castedfuncenvtmp");
+    }
+
+    // The code takes the environment as its last argument, there is no trampoline
+    if (fatClosures) {
+        auto *closureType = llvm::cast<llvm::StructType>(TG->getLLVMType(TheModule));
+        llvm::Value *closure = llvm::UndefValue::get(closureType);
+        closure = Builder.CreateInsertValue(closure, Builder.CreatePointerCast(
+            funcPrototype, closureType->getElementType(0), "castedfuncptrtmp"), 0);
+        return Builder.CreateInsertValue(closure, Builder.CreatePointerCast(
+            trampolineEnvMalloc, i8->getPointerTo(), "castedfuncenvtmp"), 1, "closure");
+    }
+
+    //TODO(ORF): Find out how much to allocate for the trampoline
+    auto trampolineMallocSize = c32(16);
+    auto trampolineMallocInst = 
+        llvm::CallInst::CreateMalloc(Builder.GetInsertBlock(),
+            machinePtrType, i8, 
+            llvm::ConstantExpr::getSizeOf(i8), trampolineMallocSize,
+            TheMalloc);
+    auto trampolineMalloc = 
+        Builder.Insert(trampolineMallocInst, getId() + ".trampmalloc");
     llvm::Function *initTrampoline = llvm::Intrinsic::getDeclaration(
         TheModule, llvm::Intrinsic::init_trampoline);
     llvm::Function *adjustTrampoline = llvm::Intrinsic::getDeclaration(
@@ -470,6 +622,59 @@ llvm::Value *Function::generateTrampoline()
     );
 
 }
+llvm::Value *Function::createDirectCall(llvm::Value *env, std::vector<llvm::Value *> args)
+{
+    args.push_back(env);
+    auto *call = Builder.CreateCall(funcPrototype, args, "func.calltmp");
+    call->setCallingConv(funcPrototype->getCallingConv());
+    return call;
+}
+llvm::Value *Function::createLiftedCall(std::vector<llvm::Value *> args)
+{
+    for (const auto &ext: external) {
+        if (ext.second != entry)
+            args.push_back(ext.second->getValue());
+    }
+    auto *call = Builder.CreateCall(funcPrototype, args, "func.calltmp");
+    call->setCallingConv(funcPrototype->getCallingConv());
+    return call;
+}
+// Nothing follows a return, the rest of the body is generated in a block
+// without predecessors that the optimizer removes
+llvm::Value *Function::continueAfterReturn(llvm::Type *type)
+{
+    llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
+    Builder.SetInsertPoint(llvm::BasicBlock::Create(TheContext, "aftertail", TheFunction));
+    return llvm::UndefValue::get(type);
+}
+llvm::Value *Function::createSelfTailCall(std::vector<llvm::Value *> args)
+{
+    for (std::size_t i = 0; i < args.size(); i++) {
+        tailRecurseArgs[i]->addIncoming(args[i], Builder.GetInsertBlock());
+    }
+    Builder.CreateBr(tailRecurse);
+    return continueAfterReturn(funcPrototype->getReturnType());
+}
+llvm::Value *Function::createTailReturn(llvm::Value *call, Function *callee)
+{
+    auto *callInst = llvm::dyn_cast<llvm::CallInst>(call);
+    // e.g. library functions returning void
+    if (!callInst || call->getType() != funcPrototype->getReturnType())
+        return call;
+    bool guaranteed = callee && callInst->getCalledFunction() == callee->funcPrototype
+        && callee->funcPrototype->getFunctionType() == funcPrototype->getFunctionType()
+        && callee->funcPrototype->getCallingConv() == funcPrototype->getCallingConv()
+        && callee->isLifted() == isLifted();
+    if (guaranteed) {
+        // the attributes of the arguments have to match those of the caller
+        callInst->setAttributes(callee->funcPrototype->getAttributes());
+        callInst->setTailCallKind(llvm::CallInst::TCK_MustTail);
+    } else {
+        callInst->setTailCallKind(llvm::CallInst::TCK_Tail);
+    }
+    Builder.CreateRet(call);
+    return continueAfterReturn(call->getType());
+}
 
 void DefStmt::processEnvBacklog() {
     std::cerr << "processEnvBacklog() called for DefStmt \n";
@@ -478,11 +683,7 @@ void DefStmt::processEnvBacklog() {
 void Function::processEnvBacklog()
 {
     for (const auto &pair: envBacklog) {
-        Builder.CreateStore(
-            Builder.CreateLoad(pair.first->getGlobalLiveValue()),
-            pair.second,
-            false
-        );
+        Builder.CreateStore(pair.first->getValue(), pair.second, false);
     }
 }
 
@@ -502,45 +703,67 @@ void Function::generateBody()
     // }
     // std::cerr << std::endl;
 
+    // The body is in the cached object of the fragment
+    if (fragment && fragment->object != "")
+        return;
+
     llvm::BasicBlock *prevBB = Builder.GetInsertBlock();
-    openScopeOfAll();
     llvm::BasicBlock *newBB = llvm::BasicBlock::Create(TheContext, "entry", funcPrototype);
     Builder.SetInsertPoint(newBB);
     int i = 0;
-    std::vector<std::pair<int,llvm::Value *>> previousGlobals;
     for (auto &arg : funcPrototype->args())
     {
-        if ((long unsigned) i == par_list.size()) {
-            arg.addAttr(llvm::Attribute::Nest);
+        if ((long unsigned) i == par_list.size())
             break; // this exits the loop after handling the 'real' args
-        }
-        arg.setName(par_list[i]->getId());
-        LLValues.insert({par_list[i]->getId(), &arg});
-        previousGlobals.push_back({i, par_list[i]->updateGlobalValue(&arg)});
+        arg.setName(par_list[i]->getId().str());
+        par_list[i]->getEntry()->setValue(&arg);
         i++;
     }
+    // captured values are restored once the body is generated,
+    // as the enclosing function goes on with its own
+    std::vector<std::pair<LivenessEntry *, llvm::Value *>> outerValues;
+    unsigned int capturedArg = par_list.size();
+    llvm::Value *envStruct = nullptr;
+    if (!isLifted())
+        envStruct = Builder.CreatePointerCast(funcPrototype->getArg(par_list.size()),
+            getEnvStructType()->getPointerTo(), "env");
     i = 0;
-    auto envStruct = funcPrototype->getArg(par_list.size());
     for (auto const &ext: external) {
-        // insert env loaded values in LLValues table
-        auto envField = Builder.CreateLoad(
-            Builder.CreateGEP(envStruct, {c32(0), c32(i)}, "envfield")
-        );
-        LLValues.insert({ext.first, envField});
-        i++;
+        llvm::Value *captured;
+        if (!isLifted()) {
+            // bind what it captures to the values loaded from the env
+            captured = Builder.CreateLoad(
+                Builder.CreateGEP(envStruct, {c32(0), c32(i++)}, "envfield")
+            );
+        } else if (ext.second == entry) {
+            continue; // calls to itself are lifted calls too
+        } else {
+            captured = funcPrototype->getArg(capturedArg++);
+            captured->setName(ext.first.str());
+        }
+        outerValues.push_back({ext.second, ext.second->getValue()});
+        ext.second->setValue(captured);
     }
-    // for (auto const &pair: previousGlobals) {
-    //     if (par_list[pair.first]->getGlobalLiveValue() == nullptr) continue;
-    //     Builder.CreateStore(pair.second, par_list[pair.first]->getGlobalLiveValue(), false);
-    // }
-    auto retVal = expr->compile();
-    for (auto const &pair: previousGlobals) {
-        if (par_list[pair.first]->getGlobalLiveValue() == nullptr) continue;
-        if (pair.second == nullptr) continue;
-        Builder.CreateStore(pair.second, par_list[pair.first]->getGlobalLiveValue());
+    // Self tail calls loop back here with the new values of the parameters,
+    // what it captures stays the same
+    if (selfTailCalls) {
+        tailRecurse = llvm::BasicBlock::Create(TheContext, "tailrecurse", funcPrototype);
+        Builder.CreateBr(tailRecurse);
+        Builder.SetInsertPoint(tailRecurse);
+        tailRecurseArgs.clear();
+        for (std::size_t j = 0; j < par_list.size(); j++) {
+            auto *arg = funcPrototype->getArg(j);
+            auto *phi = Builder.CreatePHI(arg->getType(), 2, par_list[j]->getId().str());
+            phi->addIncoming(arg, newBB);
+            tailRecurseArgs.push_back(phi);
+            par_list[j]->getEntry()->setValue(phi);
+        }
     }
+    auto retVal = expr->compile();
     Builder.CreateRet(retVal);
-    closeScopeOfAll();
+    for (auto const &pair: outerValues) {
+        pair.first->setValue(pair.second);
+    }
     bool bad = llvm::verifyFunction(*funcPrototype, &llvm::errs());
     if (bad)
     {
@@ -550,18 +773,19 @@ void Function::generateBody()
         exit(1);
     }
     Builder.SetInsertPoint(prevBB);
-    TheFPM->run(*funcPrototype);
 }
 
 llvm::Value *Function::compile()
 {
     generateLLVMPrototype();
     generateBody();
-    llvm::Value *newFunctionTrampoline = generateTrampoline();    
+    llvm::Value *newFunctionClosure = generateClosure();    
     processEnvBacklog();
-    newFunctionTrampoline->setName(id);
-    LLValues.insert({id, newFunctionTrampoline});
-    updateGlobalValue(newFunctionTrampoline);
+    // A lifted function has no value
+    if (newFunctionClosure) {
+        newFunctionClosure->setName(id.str());
+        entry->setValue(newFunctionClosure);
+    }
     return nullptr;
 }
 llvm::Value *Array::compile()
@@ -571,7 +795,7 @@ llvm::Value *Array::compile()
 
     // Create the Alloca with the correct type
     TypeGraph *containedTypeGraph = inf.deepSubstitute(T->get_TypeGraph());
-    TypeGraph *arrayTypeGraph = new ArrayTypeGraph(dimensions, new RefTypeGraph(containedTypeGraph));
+    TypeGraph *arrayTypeGraph = typeContext().getArray(dimensions, typeContext().getRef(containedTypeGraph));
     llvm::Type *LLVMContainedType = containedTypeGraph->getLLVMType(TheModule);
     llvm::Type *LLVMType = arrayTypeGraph->getLLVMType(TheModule)->getPointerElementType();
     // llvm::AllocaInst *LLVMAlloca = CreateEntryBlockAlloca(TheFunction, id, LLVMType);
@@ -638,9 +862,8 @@ llvm::Value *Array::compile()
     }
 
     // Add the array to the map
-    LLVMMAllocStruct->setName(id);
-    LLValues.insert({id, LLVMMAllocStruct});
-    updateGlobalValue(LLVMMAllocStruct);
+    LLVMMAllocStruct->setName(id.str());
+    entry->setValue(LLVMMAllocStruct);
 
     return nullptr;
 }
@@ -661,9 +884,8 @@ llvm::Value *Variable::compile()
     llvm::Value *LLVMMAlloc = Builder.Insert(LLVMMallocInst, "var.def.mutable");
 
     // Add the variable to the map
-    LLVMMAlloc->setName(id);
-    LLValues.insert({id, LLVMMAlloc});
-    updateGlobalValue(LLVMMAlloc);
+    LLVMMAlloc->setName(id.str());
+    entry->setValue(LLVMMAlloc);
 
     return nullptr;
 }
@@ -690,15 +912,17 @@ llvm::Value *Letdef::compile()
             }
             func->generateLLVMPrototype();
         }
-        // Create and store all function trampolines
+        // Create and store all function closures
         for (auto &func : def_list) 
         {
-            auto newFuncTrampoline = func->generateTrampoline();
-            newFuncTrampoline->setName(func->getId());
-            LLValues.insert({func->getId(), newFuncTrampoline});
-            func->updateGlobalValue(newFuncTrampoline);
+            auto newFuncClosure = func->generateClosure();
+            // A lifted function has no value
+            if (!newFuncClosure)
+                continue;
+            newFuncClosure->setName(func->getId().str());
+            dynamic_cast<Def *>(func)->getEntry()->setValue(newFuncClosure);
         }
-        // fill functions of all trampolines
+        // fill environments of all closures
         // (necessary to support mutually recursive funcs)
         // and then compile their bodies
         for (auto &func : def_list)
@@ -715,11 +939,34 @@ llvm::Value *Typedef::compile()
 }
 llvm::Value *Program::compile()
 {
+    // Exported functions are called through the trampolines of their values
+    if (moduleName != "")
+    {
+        for (auto *d : getExports())
+        {
+            if (d->isFunctionDefinition())
+                dynamic_cast<Function *>(d)->markEscaping();
+        }
+    }
+
     for (auto def : definition_list)
     {
         def->compile();
     }
 
+    // A module publishes the final value of every top-level name
+    if (moduleName != "")
+    {
+        for (auto *d : getExports())
+        {
+            llvm::Value *exportedVal = d->getEntry()->getValue();
+            auto *exported = new llvm::GlobalVariable(
+                *TheModule, exportedVal->getType(), false, llvm::GlobalValue::ExternalLinkage,
+                llvm::Constant::getNullValue(exportedVal->getType()), moduleName + "." + d->getId());
+            Builder.CreateStore(exportedVal, exported);
+        }
+    }
+
     return nullptr;
 }
 
@@ -1017,10 +1264,8 @@ llvm::Value *UnOp::compile()
 llvm::Value *LetIn::compile()
 {
     llvm::Value *retVal;
-    openScopeOfAll();
     letdef->compile();
     retVal = expr->compile();
-    closeScopeOfAll();
     return retVal;
 }
 llvm::Value *New::compile()
@@ -1104,9 +1349,6 @@ llvm::Value *For::compile()
     // Create value that holds the step
     llvm::Value *StepV = increment ? c32(1) : c32(-1);
 
-    // Create scope for loop variable
-    openScopeOfAll();
-
     // Begin loop
     Builder.CreateBr(LoopBB);
 
@@ -1116,11 +1358,10 @@ llvm::Value *For::compile()
     Builder.SetInsertPoint(LoopBB);
 
     // Create phi node, add an entry for start and insert to the table
-    llvm::PHINode *LoopVariable = Builder.CreatePHI(i32, 2, id);
+    llvm::PHINode *LoopVariable = Builder.CreatePHI(i32, 2, id.str());
     LoopVariable->addIncoming(StartV, PreheaderBB);
-    LoopVariable->setName(id);
-    LLValues.insert({id, LoopVariable});
-    updateGlobalValue(LoopVariable);
+    LoopVariable->setName(id.str());
+    entry->setValue(LoopVariable);
 
     // Check whether the condition is satisfied
     llvm::Value *LLVMCond =
@@ -1150,7 +1391,6 @@ llvm::Value *For::compile()
     TheFunction->getBasicBlockList().push_back(FinishBB);
     Builder.SetInsertPoint(FinishBB);
 
-    closeScopeOfAll();
     return unitVal();
 }
 llvm::Value *If::compile()
@@ -1208,7 +1448,7 @@ llvm::Value *Dim::compile()
     int selectedDim = dim->get_int() - 1;
 
     // Get the pointer to the array struct
-    llvm::Value *LLVMPointerToStruct = LLValues[id];
+    llvm::Value *LLVMPointerToStruct = lookupValue(id, definition);
 
     //
     llvm::Value *LLVMSizeLoc = Builder.CreateGEP(LLVMPointerToStruct, {c32(0), c32(selectedDim + step)}, "dimsizeloc");
@@ -1216,17 +1456,44 @@ llvm::Value *Dim::compile()
 }
 llvm::Value *ConstantCall::compile()
 {
-    return LLValues[id];
+    llvm::Value *val = lookupValue(id, definition);
+    if (auto *libFunc = llvm::dyn_cast<llvm::Function>(val))
+        return libFunctionValue(libFunc);
+    return val;
 }
 llvm::Value *FunctionCall::compile()
 {
-    llvm::Value *tempFunc = LLValues[id]; // this'll be a Function, due to sem (hopefully)
     std::vector<llvm::Value *> argsGiven;
     for (auto &arg : expr_list)
     {
         argsGiven.push_back(arg->compile());
     }
-    return Builder.CreateCall(tempFunc, argsGiven, "func.calltmp");
+    // Calls to itself in tail position loop instead
+    if (tailOf && f == tailOf)
+        return tailOf->createSelfTailCall(argsGiven);
+    llvm::Value *call;
+    // A lifted function has no value, what it captures is passed instead
+    if (f && f->isLifted())
+        call = f->createLiftedCall(argsGiven);
+    else
+    {
+        llvm::Value *tempFunc = lookupValue(id, definition); // this'll be a Function, due to sem (hopefully)
+        // A function that does not escape has no trampoline, tempFunc is its environment
+        if (f && !f->isEscaping())
+            call = f->createDirectCall(tempFunc, argsGiven);
+        // Library functions are called directly, other values are pairs with fat closures
+        else if (fatClosures && !llvm::isa<llvm::Function>(tempFunc))
+        {
+            llvm::Value *code = Builder.CreateExtractValue(tempFunc, 0, "func.code");
+            argsGiven.push_back(Builder.CreateExtractValue(tempFunc, 1, "func.env"));
+            call = Builder.CreateCall(code, argsGiven, "func.calltmp");
+        }
+        else
+            call = Builder.CreateCall(tempFunc, argsGiven, "func.calltmp");
+    }
+    if (tailOf)
+        return tailOf->createTailReturn(call, f);
+    return call;
 }
 llvm::Value *ConstructorCall::compile()
 {
@@ -1292,7 +1559,7 @@ llvm::Value *ArrayAccess::compile()
     }
 
     // Get the complete array struct as an alloca
-    llvm::Value *LLVMArrayStruct = LLValues[id];
+    llvm::Value *LLVMArrayStruct = lookupValue(id, definition);
     std::vector<llvm::Value *> LLVMSize = {};
 
     // Load necessary values
@@ -1393,8 +1660,7 @@ llvm::Value *Match::compile()
         NextClauseBB = llvm::BasicBlock::Create(TheContext, NextClauseBBName);
         SuccessBB = llvm::BasicBlock::Create(TheContext, "match.success");
 
-        // Checks whether it matched, possibly adds to LLValues
-        openScopeOfAll();
+        // Checks whether it matched, possibly binds the identifiers of the pattern
         llvm::Value *tryToMatchV = c->tryToMatch(toMatchV, NextClauseBB);
 
         // Branch to correct basic block
@@ -1407,8 +1673,6 @@ llvm::Value *Match::compile()
         // Emit code for the expression of the clause and save it
         ClauseV.push_back(c->compile());
 
-        closeScopeOfAll();
-
         // Save the current basic block for the phi node
         ClauseBB.push_back(Builder.GetInsertBlock());
 
@@ -1473,9 +1737,8 @@ llvm::Value *PatternLiteral::compile()
 llvm::Value *PatternId::compile()
 {
     // Add a variable with this value to the table
-    toMatchV->setName(id);
-    LLValues.insert({id, toMatchV});
-    updateGlobalValue(toMatchV);
+    toMatchV->setName(id.str());
+    entry->setValue(toMatchV);
 
     // Match was successful
     return c1(true);
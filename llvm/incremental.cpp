@@ -0,0 +1,196 @@
+#include <cctype>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include "ast.hpp"
+#include "incremental.hpp"
+
+/*
+ * Incremental compilation (-incremental).
+ *
+ * Every top-level let that defines functions is a fragment. Its functions,
+ * along with the functions nested in them, are compiled to an object of
+ * their own which is kept in the fragment cache. The rest of the program
+ * reaches them only through their values, and they reach it only through
+ * the symbols they capture, so a fragment is fingerprinted by its AST,
+ * the inferred types of its functions and those of the captured symbols.
+ *
+ * When the fingerprint is found in the cache only declarations are
+ * generated for the functions and the cached object is linked instead.
+ */
+
+CompileCache fragmentCache;
+std::vector<Fragment *> fragments;
+
+std::vector<std::string> fragmentObjects()
+{
+    std::vector<std::string> objects;
+    for (auto *fragment : fragments)
+    {
+        if (fragment->object != "")
+            objects.push_back(fragment->object);
+    }
+    return objects;
+}
+
+void AST::setLinkName(std::string name)
+{
+    linkName = name;
+}
+std::string AST::getLinkName()
+{
+    return linkName;
+}
+void Function::setFragment(Fragment *f)
+{
+    fragment = f;
+}
+
+// Unresolved types are named after the order they were created in,
+// so they are renumbered in order of appearance
+static std::string renumberTmpNames(std::string types)
+{
+    std::map<std::string, int> renumbered;
+    std::string result = "";
+    for (std::size_t i = 0; i < types.size(); i++)
+    {
+        if (types[i] != '@')
+        {
+            result += types[i];
+            continue;
+        }
+        std::size_t end = i + 1;
+        while (end < types.size() && std::isdigit(types[end]))
+            end++;
+        std::string name = types.substr(i, end - i);
+        if (renumbered.find(name) == renumbered.end())
+        {
+            int next = renumbered.size();
+            renumbered[name] = next;
+        }
+        result += "@" + std::to_string(renumbered[name]);
+        i = end - 1;
+    }
+    return result;
+}
+
+/*******************************************************/
+
+// By default do nothing
+void AST::planFragment(std::string context, std::map<std::string, int> &ordinals)
+{
+    return;
+}
+
+void Program::planFragments(std::string options)
+{
+    incremental = true;
+
+    // Typedefs decide the layout of every custom type
+    std::string context = options + "\n";
+    for (auto *d : definition_list)
+    {
+        if (dynamic_cast<Typedef *>(d))
+            context += d->canonicalString();
+    }
+
+    std::map<std::string, int> ordinals;
+    for (auto *d : definition_list)
+    {
+        d->planFragment(context, ordinals);
+    }
+}
+void Letdef::planFragment(std::string context, std::map<std::string, int> &ordinals)
+{
+    // Top-level names may be redefined, the ordinal tells them apart.
+    // Identifiers have no dots so these never clash with other symbols
+    std::vector<Function *> functions;
+    for (auto *d : def_list)
+    {
+        std::string id = d->getId().str();
+        d->setLinkName("llama." + id + "." + std::to_string(ordinals[id]++));
+        if (d->isFunctionDefinition())
+            functions.push_back(dynamic_cast<Function *>(d));
+    }
+    if (functions.empty())
+        return;
+
+    std::ostringstream types;
+    for (auto *f : functions)
+    {
+        types << f->getLinkName() << " : "
+              << inf.deepSubstitute(f->getTypeGraph())->stringifyTypeClean() << std::endl;
+        for (auto const &ext : f->getExternal())
+        {
+            types << "  " << ext.second->getNode()->getLinkName() << " : "
+                  << inf.deepSubstitute(ext.second->getTypeGraph())->stringifyTypeClean() << std::endl;
+        }
+    }
+
+    Fragment *fragment = new Fragment();
+    fragment->key = CompileCache::key(context + canonicalString() + renumberTmpNames(types.str()));
+    fragment->object = fragmentCache.lookup(fragment->key);
+    fragments.push_back(fragment);
+    for (auto *f : functions)
+    {
+        // Other fragments may capture it, and they are cached
+        // apart, so it is always reached through its trampoline
+        f->markEscaping();
+        f->setFragment(fragment);
+    }
+}
+
+/*******************************************************/
+
+static void removeDeadGlobals(llvm::Module &M)
+{
+    llvm::legacy::PassManager pass;
+    pass.add(llvm::createGlobalDCEPass());
+    pass.run(M);
+}
+
+void AST::compileFragments()
+{
+    for (auto *fragment : fragments)
+    {
+        if (fragment->object != "" || fragment->functions.empty())
+            continue;
+
+        // Local symbols (nested functions, strings, runtime adapters) are
+        // copied along, everything else is declared and found at link time
+        std::set<const llvm::GlobalValue *> owned(fragment->functions.begin(),
+                                                  fragment->functions.end());
+        llvm::ValueToValueMapTy VMap;
+        std::unique_ptr<llvm::Module> fragmentModule = llvm::CloneModule(
+            *TheModule, VMap,
+            [&](const llvm::GlobalValue *GV) { return GV->hasLocalLinkage() || owned.count(GV); });
+        removeDeadGlobals(*fragmentModule);
+        runOptimizationPipeline(*fragmentModule);
+
+        llvm::SmallVector<char, 0> object;
+        emitObjectCode(*fragmentModule, object);
+        fragment->object = fragmentCache.insert(fragment->key, object);
+        if (fragment->object == "")
+        {
+            std::cerr << "Couldn't write compiled fragment to the cache" << std::endl;
+            exit(1);
+        }
+    }
+
+    // The main object only keeps declarations of the fragments
+    for (auto *fragment : fragments)
+    {
+        for (auto *func : fragment->functions)
+        {
+            if (!func->isDeclaration())
+                func->deleteBody();
+        }
+    }
+    removeDeadGlobals(*TheModule);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <llvm/IR/Function.h>
+
+#include "cache.hpp"
+
+/** The functions of a top-level let, compiled to an object file of their own
+ * when compiling incrementally (-incremental). The object is kept in the
+ * fragment cache under the fingerprint of the definition: its AST, the
+ * inferred types of its functions and of the symbols they capture */
+struct Fragment
+{
+    std::string key;
+    // Path of the object in the fragment cache, "" until it is compiled
+    std::string object = "";
+    // Filled in genIR, declarations if the object was cached
+    std::vector<llvm::Function *> functions = {};
+};
+
+extern CompileCache fragmentCache;
+extern std::vector<Fragment *> fragments;
+
+/** @return The objects of all fragments, to be linked with the main one */
+std::vector<std::string> fragmentObjects();
@@ -1,38 +1,38 @@
 #include <iostream>
 #include <algorithm>
 #include "infer.hpp"
+#include "ast.hpp"
 
 using std::vector;
 using std::pair;
-using std::map;
 using std::string;
 using std::to_string;
 /********************/
 /**** Constraint ****/
 /********************/
 
-Constraint::Constraint(TypeGraph *lhs, TypeGraph *rhs, int lineno)
-: lhs(lhs), rhs(rhs), lineno(lineno), errCallback(nullptr) {}
-TypeGraph* Constraint::getLhs() { return lhs; }
-TypeGraph* Constraint::getRhs() { return rhs; }
-int Constraint::getLineNo() { return lineno; }
-void Constraint::setErrCallback(std::function<void(void)> *callback) {
-    errCallback = callback;
-}
-string Constraint::stringify() {
+static string stringifyEquation(TypeGraph *lhs, TypeGraph *rhs, int lineno) {
     return "(line " + to_string(lineno) + ") " + 
             inf.deepSubstitute(lhs)->stringifyType() + 
             " == " + inf.deepSubstitute(rhs)->stringifyType() +
             " (orig. " + lhs->stringifyType() + " == " + rhs->stringifyType() + ")";
 }
-Constraint::~Constraint() {}
+
+Constraint::Constraint(TypeGraph *lhs, TypeGraph *rhs, const ConstraintContext &context)
+: lhs(lhs), rhs(rhs), context(context) {}
+TypeGraph* Constraint::getLhs() { return lhs; }
+TypeGraph* Constraint::getRhs() { return rhs; }
+const ConstraintContext &Constraint::getContext() { return context; }
+int Constraint::getLineNo() { return context.lineno; }
+string Constraint::stringify() {
+    return stringifyEquation(lhs, rhs, context.lineno);
+}
 
 /*******************/
 /****  Inferer  ****/
 /*******************/
 
-Inferer::Inferer(bool debug): constraints(new vector<Constraint *>()),
-substitutions(new map<string, TypeGraph *>()), debug(debug) {}
+Inferer::Inferer(bool debug): debug(debug) {}
 Inferer::~Inferer() {
     //TODO: Figure out what needs to be deleted
 }
@@ -44,27 +44,26 @@ void Inferer::error(string msg) {
     log("Error: " + msg);
     exit(1);
 }
-vector<Constraint *>* Inferer::getConstraints() { return constraints; }
-map<string, TypeGraph *>* Inferer::getSubstitutions() {
-    return substitutions;
-}
 
-void Inferer::addConstraint(TypeGraph *lhs, TypeGraph *rhs, int lineno,
-std::function<void(void)> *errCallback) {
-    if (debug)
-        log("Adding constraint, " + lhs->stringifyType()
-            + " == " + rhs->stringifyType() + " (line " + to_string(lineno) + ")");
+void Inferer::addConstraint(TypeGraph *lhs, TypeGraph *rhs, int lineno) {
     lhs = tryApplySubstitutions(lhs);
     rhs = tryApplySubstitutions(rhs);
-    auto newConstraint = new Constraint(lhs, rhs, lineno);
-    if (!errCallback) {
-        errCallback = new std::function<void(void)>(
-            [=]() { log(
-                "Failed on constraint " + newConstraint->stringify()
-            );});
-    }
-    newConstraint->setErrCallback(errCallback);
-    constraints->push_back(newConstraint);
+    addConstraint(lhs, rhs,
+        ConstraintContext{ConstraintKind::Inferred, lineno, nullptr, lhs, rhs, nullptr, 0});
+}
+void Inferer::addConstraint(TypeGraph *lhs, TypeGraph *rhs, const ConstraintContext &context) {
+    if (debug)
+        log("Adding constraint, " + lhs->stringifyType()
+            + " == " + rhs->stringifyType() + " (line " + to_string(context.lineno) + ")");
+    constraints.emplace_back(tryApplySubstitutions(lhs), tryApplySubstitutions(rhs), context);
+}
+void Inferer::reportFailure(Constraint &constraint) {
+    const ConstraintContext &context = constraint.getContext();
+    if (context.node)
+        context.node->printConstraintError(context);
+    else
+        log("Failed on constraint " +
+            stringifyEquation(context.lhs, context.rhs, context.lineno));
 }
 bool Inferer::isValidSubstitution(TypeGraph *unknownType, TypeGraph* candidateType) {
     bool invalid = (
@@ -80,7 +79,9 @@ bool Inferer::isOrOccurs(TypeGraph* unknownType, TypeGraph* candidateType) {
            || occurs(unknownType, candidateType);
 }
 bool Inferer::occurs(TypeGraph *unknownType, TypeGraph* candidateType) {
-    if (candidateType->isArray() || candidateType->isRef()) {
+    if (candidateType->isResolved()) { // resolved types contain no unknown types
+        return false;
+    } else if (candidateType->isArray() || candidateType->isRef()) {
         return isOrOccurs(unknownType, 
                   tryApplySubstitutions(candidateType->getContainedType()));
     } else if (candidateType->isFunction()) { // if candidateType is a function type
@@ -95,15 +96,35 @@ bool Inferer::occurs(TypeGraph *unknownType, TypeGraph* candidateType) {
         return false; // in any other case unknownType cannot occur in candidateType (equality has been covered)
     }
 }
-void Inferer::saveSubstitution(string unknownTmpName, TypeGraph *resolvedTypeGraph) {
-    auto itr = substitutions->find(unknownTmpName);
-    if (itr == substitutions->end()) 
-        error("Internal, free type name " +
-              unknownTmpName + " not found in substitutions map");
-    if (itr->second != nullptr)
-        error("Internal, free type name " +
-              unknownTmpName + " should not be substituted twice");
-    itr->second = resolvedTypeGraph;
+unsigned long Inferer::find(unsigned long id) {
+    if (id >= nodes.size() || !nodes[id].type)
+        error("Internal, free type @" + to_string(id) + " not found");
+    while (nodes[id].parent != id) {
+        // path halving, every other node on the path skips its parent
+        nodes[id].parent = nodes[nodes[id].parent].parent;
+        id = nodes[id].parent;
+    }
+    return id;
+}
+void Inferer::unite(unsigned long id1, unsigned long id2) {
+    unsigned long root1 = find(id1), root2 = find(id2);
+    if (root1 == root2)
+        return;
+    if (nodes[root1].rank < nodes[root2].rank)
+        std::swap(root1, root2);
+    if (nodes[root1].rank == nodes[root2].rank)
+        nodes[root1].rank++;
+    nodes[root2].parent = root1;
+    // the root stands for both sets, so it gets the restrictions of both
+    nodes[root1].type->copyConstraintFlags(nodes[root2].type);
+    if (!nodes[root1].resolved)
+        nodes[root1].resolved = nodes[root2].resolved;
+}
+void Inferer::saveSubstitution(unsigned long root, TypeGraph *resolvedTypeGraph) {
+    if (nodes[root].resolved != nullptr)
+        error("Internal, free type " + nodes[root].type->getTmpName() +
+              " should not be substituted twice");
+    nodes[root].resolved = resolvedTypeGraph;
 }
 void Inferer::trySubstitute(TypeGraph *unknownType, TypeGraph *candidateType, int lineno) {
     if (debug)
@@ -117,8 +138,9 @@ void Inferer::trySubstitute(TypeGraph *unknownType, TypeGraph *candidateType, in
         error("Constraint at line " + to_string(lineno) +
               " implied recursive unknown type (occurs check)");
     if (candidateType->isUnknown())
-        candidateType->copyConstraintFlags(unknownType);
-    saveSubstitution(unknownType->getTmpName(), candidateType);
+        unite(unknownType->getId(), candidateType->getId());
+    else
+        saveSubstitution(find(unknownType->getId()), candidateType);
 }
 // utility function to not bloat the main solveOne
 bool areCompatibleArraysOrRefs(TypeGraph *a, TypeGraph *b) {
@@ -155,95 +177,104 @@ bool areCompatibleArraysOrRefs(TypeGraph *a, TypeGraph *b) {
     }
     return false;
 }
-TypeGraph* Inferer::isUnknown_Exists_HasSubstitution(TypeGraph *unknonwnType) {
-    if (!unknonwnType->isUnknown())
-        return nullptr;
-    auto itr = substitutions->find(unknonwnType->getTmpName());
-    if (itr == substitutions->end())
-        error("Internal, free type name not found in substitutions map");
-    return itr->second;
-}
 TypeGraph* Inferer::tryApplySubstitutions(TypeGraph* type) {
-    vector<string> toChange;
-    TypeGraph *next, *current = type;
-    while ((next = isUnknown_Exists_HasSubstitution(current))){
-        toChange.push_back(current->getTmpName());
-        current = next;
-    }
-    for (auto &name: toChange) { // apply final substitution to all previous for performance
-        (*substitutions)[name] = current;
-    }
-    return current;
+    if (!type->isUnknown())
+        return type;
+    UnknownNode &root = nodes[find(type->getId())];
+    return root.resolved ? root.resolved : root.type;
 }
 TypeGraph* Inferer::deepSubstitute(TypeGraph* type) {
     TypeGraph *temp = tryApplySubstitutions(type);
-    if (!temp->isFunction() && !temp->isArray() && !temp->isRef()) {
-        return temp;
-    } else if (temp->isArray() || temp->isRef()) {
-        temp->changeInner(deepSubstitute(temp->getContainedType()));
+    if (temp->isResolved() || (!temp->isFunction() && !temp->isArray() && !temp->isRef())) {
         return temp;
+    }
+    bool resolved;
+    if (temp->isArray() || temp->isRef()) {
+        TypeGraph *inner = deepSubstitute(temp->getContainedType());
+        temp->changeInner(inner);
+        // the dimensions of an array may still be inferred
+        resolved = inner->isResolved() && (temp->isRef() || temp->getDimensions() != -1);
     } else { // if isFunction()
+        resolved = true;
         for (int i = 0; i < temp->getParamCount(); i++) {
-            temp->changeInner(deepSubstitute(temp->getParamType(i)), i);
+            TypeGraph *param = deepSubstitute(temp->getParamType(i));
+            temp->changeInner(param, i);
+            resolved = resolved && param->isResolved();
         }
-        temp->changeInner(deepSubstitute(temp->getResultType()), temp->getParamCount());
-        return temp;
+        TypeGraph *result = deepSubstitute(temp->getResultType());
+        temp->changeInner(result, temp->getParamCount());
+        resolved = resolved && result->isResolved();
     }
+    // Nothing in it can change anymore, so later calls return at once
+    if (resolved)
+        temp->markResolved();
+    return temp;
 }
-TypeGraph* Inferer::getSubstitutedLhs(Constraint *constraint) {
-    return tryApplySubstitutions(constraint->getLhs());
+void Inferer::finalize() {
+    // Every unknown type of a graph is replaced by one of these,
+    // so graphs substituted later stop at resolved parts
+    for (auto &node : nodes) {
+        if (node.resolved)
+            node.resolved = deepSubstitute(node.resolved);
+    }
 }
-TypeGraph* Inferer::getSubstitutedRhs(Constraint *constraint) {
-    return tryApplySubstitutions(constraint->getRhs());
+TypeGraph* Inferer::getSubstitutedLhs(Constraint &constraint) {
+    return tryApplySubstitutions(constraint.getLhs());
+}
+TypeGraph* Inferer::getSubstitutedRhs(Constraint &constraint) {
+    return tryApplySubstitutions(constraint.getRhs());
 }
 TypeGraph* Inferer::getSubstitutedType(TypeGraph* unknownType) {
     return tryApplySubstitutions(unknownType);
 }
-bool Inferer::solveOne(Constraint *constraint) {
+bool Inferer::solveOne(Constraint &constraint) {
     TypeGraph *lhsTypeGraph = getSubstitutedLhs(constraint),
               *rhsTypeGraph = getSubstitutedRhs(constraint);
     if (debug)
-        log("Processing constraint: " + constraint->stringify());
+        log("Processing constraint: " + constraint.stringify());
     if (lhsTypeGraph->equals(rhsTypeGraph)) {
         if(debug) log("Constraint equates already equal types, ignoring...");    
     } else if (lhsTypeGraph->isUnknown()) {                                        // lhs is unknown
-        trySubstitute(lhsTypeGraph, rhsTypeGraph, constraint->getLineNo());
+        trySubstitute(lhsTypeGraph, rhsTypeGraph, constraint.getLineNo());
     } else if (rhsTypeGraph->isUnknown()) {                                         // rhs is unknown
-        trySubstitute(rhsTypeGraph, lhsTypeGraph, constraint->getLineNo());
+        trySubstitute(rhsTypeGraph, lhsTypeGraph, constraint.getLineNo());
     } else if (lhsTypeGraph->isFunction() && rhsTypeGraph->isFunction()) {          // both are function types
         if (lhsTypeGraph->getParamCount() != rhsTypeGraph->getParamCount()) {           // they have unequal parameter counts
-            error("Line " + to_string(constraint->getLineNo()) +
+            error("Line " + to_string(constraint.getLineNo()) +
                   " non-equal parameter counts");     
          } else {                                                                       // the have equal parameter counts
             if (debug)
                 log("Constraining arguments of " + lhsTypeGraph->stringifyType() +
                     " and " + rhsTypeGraph->stringifyType() +
-                    " at line " + to_string(constraint->getLineNo()));
+                    " at line " + to_string(constraint.getLineNo()));
             for (int i = 0; i < lhsTypeGraph->getParamCount(); i++) {
                 addConstraint(lhsTypeGraph->getParamType(i), rhsTypeGraph->getParamType(i),
-                              constraint->getLineNo(), constraint->errCallback); // insert constraints for parameter types
+                              constraint.getContext()); // insert constraints for parameter types
             }
             addConstraint(lhsTypeGraph->getResultType(), rhsTypeGraph->getResultType(),
-                          constraint->getLineNo(), constraint->errCallback); // insert constraint for result types
+                          constraint.getContext()); // insert constraint for result types
         }
     } else if (areCompatibleArraysOrRefs(lhsTypeGraph, rhsTypeGraph)) {             // are both refs, or arrays of same dimensions
         addConstraint(lhsTypeGraph->getContainedType(), rhsTypeGraph->getContainedType(),
-                      constraint->getLineNo(), constraint->errCallback);
+                      constraint.getContext());
     } else {                                                                        // any other case type check/inference fails
-        (*(constraint->errCallback))();
+        reportFailure(constraint);
         return false;
     }
     return true;
 }
-void Inferer::initSubstitution(string name) {
-    substitutions->insert({name, nullptr});
+void Inferer::initSubstitution(TypeGraph *unknownType) {
+    unsigned long id = unknownType->getId();
+    if (nodes.size() <= id)
+        nodes.resize(id + 1, UnknownNode{nullptr, nullptr, 0, 0});
+    nodes[id] = UnknownNode{unknownType, nullptr, id, 0};
 }
 bool Inferer::checkAllSubstituted(bool err) {
     bool success = true;
     if(debug) log("Validating all unknown types where successfuly infered...");
-    for (auto &pair: (*substitutions)) {
-        if (!pair.second || tryApplySubstitutions(pair.second)->isUnknown()) {
-            log("Type " + pair.first + " could not be infered");
+    for (unsigned long id = 0; id < nodes.size(); id++) {
+        if (nodes[id].type && !nodes[find(id)].resolved) {
+            log("Type " + nodes[id].type->getTmpName() + " could not be infered");
             if (err) exit(1);
             else success = false;
         } 
@@ -253,15 +284,20 @@ bool Inferer::checkAllSubstituted(bool err) {
     return success;
 }
 bool Inferer::solveAll(bool err) {
-    std::reverse(constraints->begin(), constraints->end());
-    Constraint *holder;
-    while(!constraints->empty()) {
-        holder = constraints->back();
-        constraints->pop_back();
+    std::reverse(constraints.begin(), constraints.end());
+    while(!constraints.empty()) {
+        // copied out, as solving it may add constraints
+        Constraint holder = constraints.back();
+        constraints.pop_back();
         if (!solveOne(holder))
             return false;
     }
-    return checkAllSubstituted(err);
+    // every constraint has been solved
+    vector<Constraint>().swap(constraints);
+    if (!checkAllSubstituted(err))
+        return false;
+    finalize();
+    return true;
 }
 
 void Inferer::enable_logs() { debug = true; }
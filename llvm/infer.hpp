@@ -3,35 +3,80 @@
 
 #include <string>
 #include <vector>
-#include <map>
-#include <functional>
 #include "types.hpp"
 
+class AST;
+
+/** What a constraint checks, picks the message it fails with */
+enum class ConstraintKind {
+    // Needed by inference itself, fails with the constraint
+    Inferred,
+    // "<msg>, <given> given."
+    TypeCheck,
+    // "<msg> <expected>, <given> given."
+    SpecifiedType,
+    // "<msg> No. <index>, <expected> expected, <given> given."
+    Parameter,
+    // "<msg> No. <index>, <given> given."
+    Field,
+    // "Expected ref, got <given>"
+    ExpectedRef,
+    // "Needs array of at least <index> dimensions"
+    Dimensions,
+    // "<msg>"
+    Message
+};
+
+/** Why a constraint was made, the message is only formatted if it fails.
+ * Constraints derived from another one while solving keep its context */
+struct ConstraintContext {
+    ConstraintKind kind;
+    int lineno;
+    // The node reporting the failure, nullptr for Inferred
+    AST *node;
+    // The types first equated, given and expected
+    TypeGraph *lhs, *rhs;
+    // A string literal
+    const char *msg;
+    int index;
+};
+
 /** Represents a single constraint */
 class Constraint {
     TypeGraph *lhs, *rhs;
-    int lineno;
-    std::string msg;
+    ConstraintContext context;
 public:
-    Constraint(TypeGraph *lhs, TypeGraph *rhs, int lineno);
-    /** Returns a container compatible reference wrapper to the lhs of the constraint */
+    Constraint(TypeGraph *lhs, TypeGraph *rhs, const ConstraintContext &context);
     TypeGraph* getLhs();
-    /** Returns a container compatible reference wrapper to the rhs of the constraint */
     TypeGraph* getRhs();
-    std::function<void(void)> *errCallback;
-    void setErrCallback(std::function<void(void)> *callback);
+    const ConstraintContext &getContext();
     int getLineNo();
     std::string stringify();
-    ~Constraint();
 };
 
 class Inferer {
     // holds all the constraints of the program
     // Changes/Empties while inference runs
-    std::vector<Constraint *> *constraints;
-    // Maps free type variables with what they should become
+    std::vector<Constraint> constraints;
+    /** A free type variable, as a node of a union-find forest. Variables
+     * of the same set have been equated, and its root stands for all */
+    struct UnknownNode {
+        // The UnknownTypeGraph of the variable
+        TypeGraph *type;
+        // What the set has been resolved to, only set on roots
+        TypeGraph *resolved;
+        // Itself for roots
+        unsigned long parent;
+        // Bounds the height of a root's tree
+        unsigned rank;
+    };
+    // Indexed by UnknownTypeGraph::getId()
     // Fills up while inference runs
-    std::map<std::string, TypeGraph *> *substitutions;
+    std::vector<UnknownNode> nodes;
+    // @return The root of the set of variable id, compressing the path to it
+    unsigned long find(unsigned long id);
+    // Equates the sets of two variables, by rank
+    void unite(unsigned long id1, unsigned long id2);
     // // Finds free type names and fills vector with them
     // // always called when there should be no substitutions yet
     // void getFreeTypes(TypeGraph *fullType, std::vector<std::string> *names);
@@ -39,11 +84,8 @@ class Inferer {
     // void initSubstitutions(std::vector<std::string> *names);
     // checks if substitution would ignore any restraints
     bool isValidSubstitution(TypeGraph *unknownType, TypeGraph *candidateType);
-    // looks up if it is unknown, the name is valid, and has been substituted,
-    // returns null if no substitution and crashes if it doesn't exist
-    TypeGraph* isUnknown_Exists_HasSubstitution(TypeGraph *unknownType);
-    // saves a substitution of a currently non substituted free type name
-    void saveSubstitution(std::string unknownTmpName, TypeGraph *resolvedTypeGraph);
+    // saves a substitution of a currently non substituted set of free types
+    void saveSubstitution(unsigned long root, TypeGraph *resolvedTypeGraph);
     // checks if a substitution is valid and applies it, otherwise crashes
     void trySubstitute(TypeGraph *unknownType, TypeGraph *candidateType, int lineno);
     /** performs an "occurs check" @param unknownType type to look for @param candidateType type to look in */
@@ -51,7 +93,9 @@ class Inferer {
     // helper for occurs check
     bool isOrOccurs(TypeGraph *unknownType, TypeGraph *candidateType);
     // Solves and removes a constraint if possible
-    bool solveOne(Constraint *constraint);
+    bool solveOne(Constraint &constraint);
+    // reports the failure of a constraint, as its context describes
+    void reportFailure(Constraint &constraint);
     // prints logs to stdout
     void log(std::string msg);
     // prints error to stdout and exits
@@ -59,24 +103,29 @@ class Inferer {
 public:
     Inferer(bool debug = false);
     void error(std::string msg);
-    std::vector<Constraint *>* getConstraints();
-    std::map<std::string, TypeGraph *>* getSubstitutions();
-    TypeGraph* getSubstitutedLhs(Constraint *constraint);
-    TypeGraph* getSubstitutedRhs(Constraint *constraint);
+    TypeGraph* getSubstitutedLhs(Constraint &constraint);
+    TypeGraph* getSubstitutedRhs(Constraint &constraint);
     TypeGraph* getSubstitutedType(TypeGraph *unknownType);
     // applies as many substitutions as possible to the given type
     // and returns the "true" current typeGraph it has been resolve too, thus far
     TypeGraph* tryApplySubstitutions(TypeGraph* unknownType);
+    /** Replaces every unknown type in the graph by what it was resolved to,
+     * marking the graph resolved once none is left */
     TypeGraph* deepSubstitute(TypeGraph* unknownType);
+    /** Deep substitutes the resolution of every unknown type,
+     * called once all constraints are solved */
+    void finalize();
     bool solveAll(bool err = true);
-    /** Stores a new constraint
+    /** Stores a new constraint, that fails with itself
      * @param lhs pointer to lhs
      * @param rhs pointer to rhs
      * @param lineno line where constraint was created
      */
-    void addConstraint(TypeGraph *lhs, TypeGraph *rhs, int lineno,
-        std::function<void(void)> *errCallback = nullptr);
-    void initSubstitution(std::string name);
+    void addConstraint(TypeGraph *lhs, TypeGraph *rhs, int lineno);
+    /** Stores a new constraint, that fails as context describes */
+    void addConstraint(TypeGraph *lhs, TypeGraph *rhs, const ConstraintContext &context);
+    /** Makes a new free type variable, in a set of its own */
+    void initSubstitution(TypeGraph *unknownType);
     bool checkAllSubstituted(bool err = true);
     void enable_logs();
     ~Inferer();
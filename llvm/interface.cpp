@@ -0,0 +1,411 @@
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+#include "ast.hpp"
+#include "interface.hpp"
+
+/*
+ * Module interfaces (-module, -use).
+ *
+ * A module is compiled to an object, which instead of main has an
+ * initializer running its top-level code, and to an interface file.
+ * The final binding of every top-level name is exported in a global
+ * named <module>.<id>, and the interface holds the fully resolved type of
+ * each one, so that dependents can load it instead of inferring the source.
+ *
+ * Interface files are binary:
+ *   "LLI" version
+ *   name, closure representation (1 if fat), objects to link
+ *   names of all custom types, then the constructors of each in order
+ *   exports: id, kind, type
+ * Strings are prefixed with their length and types are written as their
+ * graphType followed by the types they contain.
+ */
+
+std::vector<ModuleInterface *> usedModules;
+
+static const char interfaceMagic[] = {'L', 'L', 'I', 2};
+
+static void interfaceError(std::string path, std::string msg)
+{
+    std::cerr << "Interface " << path << ": " << msg << std::endl;
+    exit(1);
+}
+
+/*******************************************************/
+/**                    Writing                         */
+/*******************************************************/
+
+static void writeU32(std::ostream &out, uint32_t n)
+{
+    for (int i = 0; i < 4; i++)
+        out.put((char)((n >> (8 * i)) & 0xff));
+}
+static void writeString(std::ostream &out, const std::string &s)
+{
+    writeU32(out, s.size());
+    out.write(s.data(), s.size());
+}
+static void writeType(std::ostream &out, TypeGraph *t, std::string id)
+{
+    t = inf.deepSubstitute(t);
+    if (t->isConstructor())
+        t = t->getCustomType();
+    out.put((char)t->getSubClass());
+    switch (t->getSubClass())
+    {
+        case graphType::TYPE_unknown:
+            std::cerr << "The type of exported " << id << " couldn't be inferred" << std::endl;
+            exit(1);
+        case graphType::TYPE_ref:
+            writeType(out, t->getContainedType(), id);
+            break;
+        case graphType::TYPE_array:
+            writeU32(out, t->getDimensions());
+            writeType(out, t->getContainedType(), id);
+            break;
+        case graphType::TYPE_function:
+            writeU32(out, t->getParamCount());
+            for (auto *param : t->getParamTypes())
+                writeType(out, param, id);
+            writeType(out, t->getResultType(), id);
+            break;
+        case graphType::TYPE_custom:
+            writeString(out, t->stringifyTypeClean());
+            break;
+        default: // basic types
+            break;
+    }
+}
+
+std::vector<Def *> Program::getExports()
+{
+    // Later top-level definitions shadow earlier ones with the same name
+    std::vector<Symbol> order;
+    std::unordered_map<Symbol, Def *> last;
+    for (auto *d : definition_list)
+    {
+        Letdef *letdef = dynamic_cast<Letdef *>(d);
+        if (!letdef)
+            continue;
+        for (auto *def : letdef->getDefList())
+        {
+            Def *exported = dynamic_cast<Def *>(def);
+            if (!exported)
+                continue;
+            if (last.find(exported->getId()) == last.end())
+                order.push_back(exported->getId());
+            last[exported->getId()] = exported;
+        }
+    }
+    std::vector<Def *> exports;
+    for (auto &id : order)
+        exports.push_back(last[id]);
+    return exports;
+}
+
+void Program::writeInterface(std::string path, std::string objectPath)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        interfaceError(path, "couldn't be created");
+    out.write(interfaceMagic, sizeof(interfaceMagic));
+    writeString(out, moduleNameOf(objectPath));
+    // Function values are exported as they are represented
+    out.put(AST::usesFatClosures() ? 1 : 0);
+
+    // Dependents link the modules this one uses as well
+    std::vector<std::string> objects = usedModuleObjects();
+    char *absolute = realpath(objectPath.c_str(), nullptr);
+    objects.push_back(absolute ? absolute : objectPath);
+    std::free(absolute);
+    writeU32(out, objects.size());
+    for (auto &o : objects)
+        writeString(out, o);
+
+    // All custom types known, including those of used modules, as
+    // exported types may refer to any of them
+    std::vector<TypeEntry *> types;
+    for (auto &pair : *tt.Table)
+    {
+        if (pair.second->getTypeGraph()->isCustom())
+            types.push_back(dynamic_cast<TypeEntry *>(pair.second));
+    }
+    writeU32(out, types.size());
+    for (auto *t : types)
+        writeString(out, t->name.str());
+    for (auto *t : types)
+    {
+        writeU32(out, t->constructors->size());
+        for (auto *c : *t->constructors)
+        {
+            writeString(out, c->name.str());
+            auto fields = c->getTypeGraph()->getFields();
+            writeU32(out, fields.size());
+            for (auto *field : fields)
+                writeType(out, field, c->name.str());
+        }
+    }
+
+    std::vector<Def *> exports = getExports();
+    writeU32(out, exports.size());
+    for (auto *d : exports)
+    {
+        ModuleInterface::ExportKind kind = ModuleInterface::EXPORT_basic;
+        if (d->isFunctionDefinition())
+            kind = ModuleInterface::EXPORT_function;
+        else if (dynamic_cast<Array *>(d))
+            kind = ModuleInterface::EXPORT_array;
+        else if (dynamic_cast<Variable *>(d))
+            kind = ModuleInterface::EXPORT_ref;
+        writeString(out, d->getId().str());
+        out.put(kind);
+        writeType(out, d->getTypeGraph(), d->getId().str());
+    }
+
+    out.close();
+    if (out.fail())
+        interfaceError(path, "couldn't be written");
+}
+
+/*******************************************************/
+/**                    Reading                         */
+/*******************************************************/
+
+class InterfaceReader
+{
+    std::string path;
+    std::ifstream in;
+
+public:
+    InterfaceReader(std::string path)
+        : path(path), in(path, std::ios::binary)
+    {
+        if (!in)
+            interfaceError(path, "couldn't be opened");
+    }
+    void check()
+    {
+        if (!in)
+            interfaceError(path, "is truncated or corrupt");
+    }
+    uint32_t u32()
+    {
+        unsigned char bytes[4];
+        in.read((char *)bytes, 4);
+        check();
+        return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+    }
+    char byte()
+    {
+        char c = 0;
+        in.get(c);
+        check();
+        return c;
+    }
+    std::string string()
+    {
+        std::string s(u32(), '\0');
+        in.read(&s[0], s.size());
+        check();
+        return s;
+    }
+    TypeGraph *type()
+    {
+        graphType t = (graphType)byte();
+        switch (t)
+        {
+            case graphType::TYPE_unit:
+                return tt.lookupType("unit")->getTypeGraph();
+            case graphType::TYPE_int:
+                return tt.lookupType("int")->getTypeGraph();
+            case graphType::TYPE_float:
+                return tt.lookupType("float")->getTypeGraph();
+            case graphType::TYPE_bool:
+                return tt.lookupType("bool")->getTypeGraph();
+            case graphType::TYPE_char:
+                return tt.lookupType("char")->getTypeGraph();
+            case graphType::TYPE_ref:
+                return typeContext().getRef(type());
+            case graphType::TYPE_array:
+            {
+                int dimensions = u32();
+                return typeContext().getArray(dimensions, type());
+            }
+            case graphType::TYPE_function:
+            {
+                std::vector<TypeGraph *> params;
+                for (uint32_t n = u32(); n > 0; n--)
+                    params.push_back(type());
+                return typeContext().getFunction(params, type());
+            }
+            case graphType::TYPE_custom:
+            {
+                std::string name = string();
+                TypeEntry *entry = tt.lookupType(name);
+                if (!entry)
+                    interfaceError(path, "refers to unknown type " + name);
+                return entry->getTypeGraph();
+            }
+            default:
+                interfaceError(path, "is truncated or corrupt");
+                return nullptr;
+        }
+    }
+    ModuleInterface *read();
+};
+
+ModuleInterface *InterfaceReader::read()
+{
+    char magic[sizeof(interfaceMagic)];
+    in.read(magic, sizeof(magic));
+    if (!in || std::string(magic, sizeof(magic)) != std::string(interfaceMagic, sizeof(interfaceMagic)))
+        interfaceError(path, "isn't an interface of this compiler version");
+
+    ModuleInterface *m = new ModuleInterface();
+    m->name = string();
+    if ((byte() == 1) != AST::usesFatClosures())
+        interfaceError(path, "was compiled with other -closures");
+    for (uint32_t n = u32(); n > 0; n--)
+        m->objects.push_back(string());
+
+    // Types come first so that constructor fields can refer to any of them.
+    // A type already known comes from another interface that shares it
+    std::vector<std::pair<TypeEntry *, bool>> types;
+    for (uint32_t n = u32(); n > 0; n--)
+    {
+        std::string name = string();
+        if (TypeEntry *known = tt.lookupType(name))
+            types.push_back({known, true});
+        else
+            types.push_back({tt.insertType(name), false});
+    }
+    for (auto &t : types)
+    {
+        TypeEntry *entry = t.first;
+        bool known = t.second;
+        uint32_t count = u32();
+        if (known && count != entry->constructors->size())
+            interfaceError(path, "defines type " + entry->name + " differently from another module");
+        for (uint32_t i = 0; i < count; i++)
+        {
+            std::string name = string();
+            std::vector<TypeGraph *> fields;
+            for (uint32_t n = u32(); n > 0; n--)
+                fields.push_back(type());
+            if (known)
+            {
+                if ((*entry->constructors)[i]->name != name)
+                    interfaceError(path, "defines type " + entry->name + " differently from another module");
+                continue;
+            }
+            ConstructorEntry *c = ct.insertConstructor(name);
+            if (!c)
+                interfaceError(path, "defines constructor " + name + " which is already defined");
+            for (auto *field : fields)
+                c->addType(field);
+            entry->addConstructor(c);
+        }
+    }
+
+    for (uint32_t n = u32(); n > 0; n--)
+    {
+        std::string id = string();
+        ModuleInterface::ExportKind kind = (ModuleInterface::ExportKind)byte();
+        m->exports.push_back({id, kind, type()});
+    }
+    return m;
+}
+
+void loadInterfaces(std::string paths)
+{
+    std::stringstream list(paths);
+    std::string path;
+    while (std::getline(list, path, ','))
+    {
+        if (path == "")
+            continue;
+        usedModules.push_back(InterfaceReader(path).read());
+    }
+}
+
+void insertUsedModulesToSymbolTable()
+{
+    for (auto *m : usedModules)
+    {
+        for (auto &e : m->exports)
+        {
+            switch (e.kind)
+            {
+                case ModuleInterface::EXPORT_function:
+                {
+                    FunctionEntry *f = st.insertFunction(e.id, e.type->getResultType());
+                    for (auto *param : e.type->getParamTypes())
+                        f->addParam(param);
+                    break;
+                }
+                case ModuleInterface::EXPORT_array:
+                    st.insertArray(e.id, e.type->getContainedType(), e.type->getDimensions());
+                    break;
+                case ModuleInterface::EXPORT_ref:
+                    st.insertRef(e.id, e.type->getContainedType());
+                    break;
+                default:
+                    st.insertBasic(e.id, e.type);
+                    break;
+            }
+        }
+    }
+}
+
+std::vector<std::string> usedModuleObjects()
+{
+    std::vector<std::string> objects;
+    std::set<std::string> seen;
+    for (auto *m : usedModules)
+    {
+        for (auto &o : m->objects)
+        {
+            if (seen.insert(o).second)
+                objects.push_back(o);
+        }
+    }
+    return objects;
+}
+
+std::string usedModulesSignature()
+{
+    std::string signature = "";
+    for (auto *m : usedModules)
+    {
+        for (auto &e : m->exports)
+            signature += " " + m->name + "." + e.id + ":" + e.type->stringifyTypeClean();
+    }
+    return signature;
+}
+
+std::string moduleNameOf(std::string objectPath)
+{
+    std::string stem = objectPath;
+    std::size_t slash = stem.find_last_of('/');
+    if (slash != std::string::npos)
+        stem = stem.substr(slash + 1);
+    std::size_t dot = stem.find_last_of('.');
+    if (dot != std::string::npos && dot != 0)
+        stem = stem.substr(0, dot);
+    return stem;
+}
+
+std::string interfacePathOf(std::string objectPath)
+{
+    std::size_t slash = objectPath.find_last_of('/'), dot = objectPath.find_last_of('.');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash + 1))
+        objectPath = objectPath.substr(0, dot);
+    return objectPath + ".lli";
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+/** What a module compiled with -module exports, as read back from its
+ * interface file (.lli) by the programs and modules that -use it */
+struct ModuleInterface
+{
+    /** Decides the kind of symbol table entry, like the definitions do */
+    enum ExportKind : char
+    {
+        EXPORT_basic = 'b',
+        EXPORT_function = 'f',
+        EXPORT_array = 'a',
+        EXPORT_ref = 'r'
+    };
+    struct Export
+    {
+        std::string id;
+        ExportKind kind;
+        TypeGraph *type;
+    };
+    std::string name;
+    // Objects to link, those of the modules it uses before its own
+    std::vector<std::string> objects;
+    std::vector<Export> exports;
+};
+
+extern std::vector<ModuleInterface *> usedModules;
+
+/** Reads the interfaces given to -use (comma separated) into usedModules,
+ * registering their custom types and constructors in tt and ct */
+void loadInterfaces(std::string paths);
+/** Makes the exports of the used modules visible to the program (in st) */
+void insertUsedModulesToSymbolTable();
+/** @return The objects of all used modules in link order, without duplicates */
+std::vector<std::string> usedModuleObjects();
+/** @return Every export of the used modules with its type, in a canonical form */
+std::string usedModulesSignature();
+
+/** @return The name of the module compiled to the given object, its stem */
+std::string moduleNameOf(std::string objectPath);
+/** @return The interface file written next to the given object */
+std::string interfacePathOf(std::string objectPath);
@@ -0,0 +1,91 @@
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+
+#include "intern.hpp"
+
+/** Owns the name of every symbol, ids index names in order of interning.
+ * Names are kept in chunks that never move, so reading one takes no lock:
+ * a chunk is published before the ids in it are handed out */
+class SymbolPool
+{
+    static const SymbolId chunkBits = 12, chunkSize = 1 << chunkBits, maxChunks = 1 << 16;
+
+    std::mutex lock; // held while interning
+    std::unordered_map<std::string, SymbolId> ids;
+    std::atomic<std::string *> chunks[maxChunks];
+    std::atomic<SymbolId> count;
+
+public:
+    SymbolPool() : count(0)
+    {
+        for (auto &chunk : chunks)
+            chunk.store(nullptr, std::memory_order_relaxed);
+        // Id 0, that of value initialized symbols
+        intern("");
+    }
+    SymbolId intern(const std::string &name)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = ids.find(name);
+        if (it != ids.end())
+            return it->second;
+        SymbolId id = count.load(std::memory_order_relaxed);
+        if ((id >> chunkBits) >= maxChunks)
+        {
+            std::cerr << "Too many identifiers" << std::endl;
+            exit(1);
+        }
+        std::string *chunk = chunks[id >> chunkBits].load(std::memory_order_relaxed);
+        if (!chunk)
+            chunk = new std::string[chunkSize];
+        chunk[id & (chunkSize - 1)] = name;
+        chunks[id >> chunkBits].store(chunk, std::memory_order_release);
+        count.store(id + 1, std::memory_order_release);
+        ids.emplace(name, id);
+        return id;
+    }
+    const std::string &name(SymbolId id)
+    {
+        return chunks[id >> chunkBits].load(std::memory_order_acquire)[id & (chunkSize - 1)];
+    }
+};
+
+// Tables constructed statically insert symbols, so the pool is made on first use
+static SymbolPool &symbolPool()
+{
+    static SymbolPool pool;
+    return pool;
+}
+
+Symbol::Symbol(const std::string &name)
+    : id(symbolPool().intern(name)) {}
+Symbol::Symbol(const char *name)
+    : id(symbolPool().intern(name)) {}
+
+const std::string &Symbol::str() const
+{
+    return symbolPool().name(id);
+}
+
+std::ostream &operator<<(std::ostream &out, Symbol s)
+{
+    return out << s.str();
+}
+std::string operator+(const std::string &lhs, Symbol rhs)
+{
+    return lhs + rhs.str();
+}
+std::string operator+(Symbol lhs, const std::string &rhs)
+{
+    return lhs.str() + rhs;
+}
+std::string operator+(const char *lhs, Symbol rhs)
+{
+    return lhs + rhs.str();
+}
+std::string operator+(Symbol lhs, const char *rhs)
+{
+    return lhs.str() + rhs;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+
+typedef uint32_t SymbolId;
+
+/** An identifier interned in the global symbol pool. Symbols are compared
+ * and hashed by their id, the name is only looked up to be printed.
+ * Trivially copyable, so that it can be a bison semantic value */
+class Symbol
+{
+    SymbolId id;
+
+public:
+    Symbol() = default;
+    /** Interns name, safe to call from several threads at once */
+    Symbol(const std::string &name);
+    Symbol(const char *name);
+
+    /** The symbol with an id returned by getId */
+    static Symbol fromId(SymbolId id)
+    {
+        Symbol s;
+        s.id = id;
+        return s;
+    }
+    SymbolId getId() const { return id; }
+    /** Takes no lock. There is deliberately no implicit conversion, so
+     * that turning symbols back into strings shows in the code */
+    const std::string &str() const;
+
+    bool operator==(Symbol other) const { return id == other.id; }
+    bool operator!=(Symbol other) const { return id != other.id; }
+    /** Orders by interning, not alphabetically */
+    bool operator<(Symbol other) const { return id < other.id; }
+};
+
+/** Orders alphabetically, e.g. where the order is visible in the output */
+struct SymbolNameLess
+{
+    bool operator()(Symbol a, Symbol b) const { return a.str() < b.str(); }
+};
+
+std::ostream &operator<<(std::ostream &out, Symbol s);
+std::string operator+(const std::string &lhs, Symbol rhs);
+std::string operator+(Symbol lhs, const std::string &rhs);
+std::string operator+(const char *lhs, Symbol rhs);
+std::string operator+(Symbol lhs, const char *rhs);
+
+namespace std
+{
+    template <>
+    struct hash<Symbol>
+    {
+        size_t operator()(Symbol s) const { return s.getId(); }
+    };
+}
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "ast.hpp"
+
+#define XSTR(s) STR(s)
+#define STR(s) #s
+
+#ifndef LIBLLAMA
+#error Location of llama runtime library must be specified
+#endif // LIBLLAMA
+
+static void jitError(llvm::Error err)
+{
+    llvm::errs() << "JIT error: " << llvm::toString(std::move(err)) << "\n";
+    exit(1);
+}
+
+int AST::runInJIT()
+{
+    // The JIT must own the context of the module it runs and TheContext
+    // is static, so the module moves over to a fresh context as bitcode
+    llvm::SmallVector<char, 0> bitcode;
+    llvm::raw_svector_ostream bitcodeStream(bitcode);
+    llvm::WriteBitcodeToFile(*TheModule, bitcodeStream);
+    std::unique_ptr<llvm::LLVMContext> context(new llvm::LLVMContext());
+    auto module = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()), "llama"), *context);
+    if (!module)
+        jitError(module.takeError());
+
+    // Globals in JIT memory are not seen by the collector unless added as
+    // roots, so they are made visible by name (but hidden from other code)
+    std::vector<std::pair<std::string, uint64_t>> gcRoots;
+    for (auto &G : (*module)->globals())
+    {
+        if (G.isDeclaration() || G.isConstant())
+            continue;
+        if (G.hasLocalLinkage())
+        {
+            G.setLinkage(llvm::GlobalValue::ExternalLinkage);
+            G.setVisibility(llvm::GlobalValue::HiddenVisibility);
+        }
+        if (!G.hasName())
+            G.setName("llama.global");
+        gcRoots.push_back({G.getName().str(),
+                           (*module)->getDataLayout().getTypeAllocSize(G.getValueType())});
+    }
+
+    llvm::orc::JITTargetMachineBuilder JTMB(llvm::Triple(llvm::sys::getDefaultTargetTriple()));
+    JTMB.setCPU(targetCPU);
+    llvm::StringRef features(targetFeatures);
+    while (!features.empty())
+    {
+        auto split = features.split(',');
+        JTMB.getFeatures().AddFeature(split.first);
+        features = split.second;
+    }
+    static const llvm::CodeGenOpt::Level codeGenLevels[] = {
+        llvm::CodeGenOpt::None, llvm::CodeGenOpt::Less,
+        llvm::CodeGenOpt::Default, llvm::CodeGenOpt::Aggressive};
+    JTMB.setCodeGenOptLevel(codeGenLevels[optimizationLevel]);
+
+    auto jit = llvm::orc::LLJITBuilder().setJITTargetMachineBuilder(std::move(JTMB)).create();
+    if (!jit)
+        jitError(jit.takeError());
+    auto &JD = (*jit)->getMainJITDylib();
+    char prefix = (*jit)->getDataLayout().getGlobalPrefix();
+
+    // Same lookup order as the linker: runtime library, libgc, then libc
+    auto runtime = llvm::orc::StaticLibraryDefinitionGenerator::Load(
+        (*jit)->getObjLinkingLayer(), XSTR(LIBLLAMA));
+    if (!runtime)
+        jitError(runtime.takeError());
+    JD.addGenerator(std::move(*runtime));
+#ifdef LIBGC
+    auto gc = llvm::orc::DynamicLibrarySearchGenerator::Load(XSTR(LIBGC), prefix);
+    if (!gc)
+        jitError(gc.takeError());
+    JD.addGenerator(std::move(*gc));
+#endif // LIBGC
+    auto process = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(prefix);
+    if (!process)
+        jitError(process.takeError());
+    JD.addGenerator(std::move(*process));
+
+    if (auto err = (*jit)->addIRModule(
+            llvm::orc::ThreadSafeModule(std::move(*module), std::move(context))))
+        jitError(std::move(err));
+
+    auto mainSymbol = (*jit)->lookup("main");
+    if (!mainSymbol)
+        jitError(mainSymbol.takeError());
+
+#ifdef LIBGC
+    auto addRoots = (void (*)(void *, void *))
+        llvm::sys::DynamicLibrary::SearchForAddressOfSymbol("GC_add_roots");
+    for (auto &root : gcRoots)
+    {
+        auto symbol = (*jit)->lookup(root.first);
+        if (!symbol)
+            jitError(symbol.takeError());
+        char *start = (char *)symbol->getAddress();
+        if (addRoots)
+            addRoots(start, start + root.second);
+    }
+#endif // LIBGC
+
+    auto llamaMain = (int (*)())mainSymbol->getAddress();
+    std::cout.flush();
+    llvm::outs().flush();
+    return llamaMain();
+}
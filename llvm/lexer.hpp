@@ -1,8 +1,34 @@
 #ifndef __LEXER_HPP__
 #define __LEXER_HPP__
 
-int yylex();
-void yyerror(const char *msg);
-extern int yylineno;
+#include <cstddef>
 
-#endif
\ No newline at end of file
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+class Program;
+
+/** Everything a parse keeps, so that several sources can be parsed at
+ * the same time in different threads. The scanner reads the source in
+ * place from a buffer, whose last two bytes must be NUL */
+struct ParseContext
+{
+    yyscan_t scanner;
+    int commentDepth = 0;
+    // Set once the whole program has been parsed
+    Program *program = nullptr;
+
+    ParseContext(char *base, std::size_t size);
+    ~ParseContext();
+};
+
+/** Line of the last token scanned in this thread, where new AST nodes are */
+extern thread_local int currentLine;
+
+void yyerror(yyscan_t scanner, const char *msg);
+int yyget_lineno(yyscan_t scanner);
+ParseContext *yyget_extra(yyscan_t scanner);
+
+#endif
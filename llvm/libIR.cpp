@@ -1,5 +1,4 @@
 #include <llvm/IR/IRBuilder.h>
-#include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/Verifier.h>
@@ -58,7 +57,6 @@ llvm::Function* AST::createFuncAdapterFromVoidToUnit(llvm::Function *voidFunc) {
     } else {
         TmpB.CreateRet(TmpB.CreateCall(voidFunc, params, "to.unit.wrapper"));
     }
-    TheFPM->run(*wrapperFunc);
     return wrapperFunc;
 }
 // Get's a function with string parameter and/or result type and creates an adapter with array of char
@@ -113,14 +111,49 @@ llvm::Function* AST::createFuncAdapterFromStringToCharArr(llvm::Function *string
         retValCandidate = arrayOfCharVal;
     }
     TmpB.CreateRet(retValCandidate);
-    TheFPM->run(*wrapperFunc);
     return wrapperFunc;
 }
 
+// Get's a library function and creates an adapter that also takes an environment, as the code of closures does
+// This is necessary to use library functions as values with fat closures
+llvm::Function* AST::createFuncAdapterWithEnv(llvm::Function *libFunc) {
+    std::string adapterName = "with.env." + libFunc->getName().str();
+    if (llvm::Function *existing = TheModule->getFunction(adapterName))
+        return existing;
+    std::vector<llvm::Type *> paramTypes = {};
+    for (auto &arg: libFunc->args()) { // copy types to keep them the same
+        paramTypes.push_back(arg.getType());
+    }
+    paramTypes.push_back(i8->getPointerTo()); // the environment, ignored
+
+    llvm::FunctionType *wrapperFuncType = llvm::FunctionType::get(libFunc->getReturnType(), paramTypes, false);
+    llvm::Function *wrapperFunc = llvm::Function::Create(wrapperFuncType, llvm::Function::InternalLinkage,
+                                  adapterName, TheModule);
+    llvm::BasicBlock *wrapperFuncBB = llvm::BasicBlock::Create(TheModule->getContext(), "entry", wrapperFunc);
+
+    llvm::IRBuilder<> TmpB(TheModule->getContext()); TmpB.SetInsertPoint(wrapperFuncBB);
+    std::vector<llvm::Value *> params = {};
+    for (auto &arg: libFunc->args()) {
+        params.push_back(wrapperFunc->getArg(arg.getArgNo()));
+    }
+    if (libFunc->getReturnType()->isVoidTy()) {
+        TmpB.CreateCall(libFunc, params);
+        TmpB.CreateRetVoid();
+    } else {
+        TmpB.CreateRet(TmpB.CreateCall(libFunc, params, "with.env.wrapper"));
+    }
+    return wrapperFunc;
+}
+llvm::Value* AST::libFunctionValue(llvm::Function *libFunc) {
+    if (!fatClosures)
+        return libFunc;
+    return llvm::ConstantStruct::getAnon(TheContext,
+        {createFuncAdapterWithEnv(libFunc), llvm::ConstantPointerNull::get(i8->getPointerTo())});
+}
+
 llvm::Function* adaptReadString(llvm::Function *ReadString, llvm::Module *TheModule,
                                 llvm::FunctionType *arrchar_to_unit, llvm::Value *unitVal,
-                                llvm::Value *c32_0, llvm::Value *c32_1, llvm::Value *c32_2,
-                                llvm::legacy::FunctionPassManager *TheFPM) {
+                                llvm::Value *c32_0, llvm::Value *c32_1, llvm::Value *c32_2) {
     llvm::Function *readStringAdapted = llvm::Function::Create(arrchar_to_unit, llvm::Function::InternalLinkage,
                                                                "read_string", TheModule);
     llvm::BasicBlock *readStringAdaptedBB = llvm::BasicBlock::Create(TheModule->getContext(), "entry", readStringAdapted);
@@ -132,11 +165,10 @@ llvm::Function* adaptReadString(llvm::Function *ReadString, llvm::Module *TheMod
     llvm::Value *readStringString = TmpB.CreateLoad(readStringStringLoc);
     TmpB.CreateCall(ReadString, {readStringSize, readStringString});
     TmpB.CreateRet(unitVal);
-    TheFPM->run(*readStringAdapted);
     return readStringAdapted;
 }
 
-llvm::Function *createIncrLibFunc(llvm::Module *TheModule, llvm::Type *unitType, llvm::Value *c32_1, llvm::Value *unitVal, llvm::legacy::FunctionPassManager *TheFPM) {
+llvm::Function *createIncrLibFunc(llvm::Module *TheModule, llvm::Type *unitType, llvm::Value *c32_1, llvm::Value *unitVal) {
     llvm::FunctionType *intptr_to_unit =
         llvm::FunctionType::get(unitType, {llvm::Type::getInt32PtrTy(TheModule->getContext())}, false);
     llvm::Function *incrFunc = 
@@ -146,11 +178,10 @@ llvm::Function *createIncrLibFunc(llvm::Module *TheModule, llvm::Type *unitType,
     llvm::Value *prevVal = TmpB.CreateLoad(incrFunc->getArg(0), "prevval");
     TmpB.CreateStore(TmpB.CreateAdd(prevVal, c32_1, "newval"), incrFunc->getArg(0));
     TmpB.CreateRet(unitVal);
-    TheFPM->run(*incrFunc);
     return incrFunc;
 }
 
-llvm::Function *createDecrLibFunc(llvm::Module *TheModule, llvm::Type *unitType, llvm::Value *c32_1, llvm::Value *unitVal, llvm::legacy::FunctionPassManager *TheFPM) {
+llvm::Function *createDecrLibFunc(llvm::Module *TheModule, llvm::Type *unitType, llvm::Value *c32_1, llvm::Value *unitVal) {
     llvm::FunctionType *intptr_to_unit =
         llvm::FunctionType::get(unitType, {llvm::Type::getInt32PtrTy(TheModule->getContext())}, false);
     llvm::Function *decrFunc = 
@@ -160,11 +191,10 @@ llvm::Function *createDecrLibFunc(llvm::Module *TheModule, llvm::Type *unitType,
     llvm::Value *prevVal = TmpB.CreateLoad(decrFunc->getArg(0), "prevval");
     TmpB.CreateStore(TmpB.CreateSub(prevVal, c32_1, "newval"), decrFunc->getArg(0));
     TmpB.CreateRet(unitVal);
-    TheFPM->run(*decrFunc);
     return decrFunc;
 }
 
-llvm::Function *createFloatOfIntLibFunc(llvm::Module *TheModule, llvm::Type *flt, llvm::legacy::FunctionPassManager *TheFPM) {
+llvm::Function *createFloatOfIntLibFunc(llvm::Module *TheModule, llvm::Type *flt) {
     llvm::FunctionType *int_to_float =
         llvm::FunctionType::get(flt, {llvm::Type::getInt32Ty(TheModule->getContext())}, false);
     llvm::Function *floatOfIntFunc =
@@ -173,7 +203,6 @@ llvm::Function *createFloatOfIntLibFunc(llvm::Module *TheModule, llvm::Type *flt
     llvm::IRBuilder<> TmpB(TheModule->getContext()); TmpB.SetInsertPoint(floatOfIntBB);
     llvm::Value *newFloat = TmpB.CreateCast(llvm::Instruction::SIToFP, floatOfIntFunc->getArg(0), flt, "newfloat");
     TmpB.CreateRet(newFloat);
-    TheFPM->run(*floatOfIntFunc);
     return floatOfIntFunc;
 }
 
@@ -232,7 +261,7 @@ std::vector<std::pair<std::string, llvm::Function*>>* AST::genLibGlueLogic() {
     IOlibAdapted[10] = createFuncAdapterFromStringToCharArr(IOlibAdapted[10]); // this SHOULD be StrCat
 
     IOlibAdapted.push_back(adaptReadString(ReadString, TheModule, arrchar_to_unit, unitVal(),
-                                           c32(0), c32(1), c32(2), TheFPM));
+                                           c32(0), c32(1), c32(2)));
     IOlibAdapted.push_back(createFuncAdapterFromStringToCharArr(StrLen));
     IOlibAdapted.push_back(createFuncAdapterFromStringToCharArr(StrCmp));
 
@@ -284,14 +313,14 @@ std::vector<std::pair<std::string, llvm::Function*>>* AST::genLibGlueLogic() {
     pairs->push_back({"int_of_char", Ord});
     pairs->push_back({"char_of_int", Chr});
 
-    pairs->push_back({"incr", createIncrLibFunc(TheModule, unitType, c32(1), unitVal(), TheFPM)});
-    pairs->push_back({"decr", createDecrLibFunc(TheModule, unitType, c32(1), unitVal(), TheFPM)});
-    pairs->push_back({"float_of_int", createFloatOfIntLibFunc(TheModule, flt, TheFPM)});
+    pairs->push_back({"incr", createIncrLibFunc(TheModule, unitType, c32(1), unitVal())});
+    pairs->push_back({"decr", createDecrLibFunc(TheModule, unitType, c32(1), unitVal())});
+    pairs->push_back({"float_of_int", createFloatOfIntLibFunc(TheModule, flt)});
 
     llvm::FunctionType *powType = 
         llvm::FunctionType::get(flt, {flt, flt}, false);
     llvm::Function *pow =
-        llvm::Function::Create(powType, llvm::Function::ExternalLinkage, "pow.custom", TheModule);
+        llvm::Function::Create(powType, llvm::Function::InternalLinkage, "pow.custom", TheModule);
     llvm::BasicBlock *powBB = llvm::BasicBlock::Create(TheContext, "entry", pow);
     llvm::BasicBlock *signApplierBB = llvm::BasicBlock::Create(TheContext, "signapply", pow);
     llvm::BasicBlock *collectorBB = llvm::BasicBlock::Create(TheContext, "collector", pow);
@@ -314,7 +343,6 @@ std::vector<std::pair<std::string, llvm::Function*>>* AST::genLibGlueLogic() {
     fullRes->addIncoming(negRes, signApplierBB);
     TmpB.CreateRet(fullRes);
     
-    TheFPM->run(*pow);
     // for (auto &pair: *pairs) {
     //     std::cout << pair.first << ' ' << pair.second->getName().str() << '\n';
     // }
@@ -0,0 +1,83 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <lld/Common/Driver.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "link.hpp"
+
+#define XSTR(s) STR(s)
+#define STR(s) #s
+
+#ifndef LIBLLAMA
+#error Location of llama runtime library must be specified
+#endif // LIBLLAMA
+#ifndef CRTDIR
+#error Location of the C runtime startup files must be specified
+#endif // CRTDIR
+#ifndef GCCLIBDIR
+#error Location of libgcc and crtbegin.o/crtend.o must be specified
+#endif // GCCLIBDIR
+#ifndef DYNLINKER
+#error Path of the dynamic linker must be specified
+#endif // DYNLINKER
+
+bool linkExecutable(llvm::ArrayRef<char> object, std::string output,
+                    const std::vector<std::string> &objects)
+{
+    // lld only reads inputs by path, so the object goes into an anonymous
+    // in-memory file and is passed as /proc/self/fd/N
+    int fd = memfd_create("llama-object", MFD_CLOEXEC);
+    if (fd == -1)
+    {
+        std::cerr << "Couldn't create in-memory object file" << std::endl;
+        return false;
+    }
+    std::size_t written = 0;
+    while (written < object.size())
+    {
+        ssize_t n = write(fd, object.data() + written, object.size() - written);
+        if (n <= 0)
+        {
+            std::cerr << "Couldn't write in-memory object file" << std::endl;
+            close(fd);
+            return false;
+        }
+        written += n;
+    }
+    std::string objectPath = "/proc/self/fd/" + std::to_string(fd);
+
+    // The same line the compiler driver passes for a non-PIE executable
+    std::string crtDir = XSTR(CRTDIR), gccLibDir = XSTR(GCCLIBDIR);
+    std::string crt1 = crtDir + "/crt1.o", crti = crtDir + "/crti.o",
+                crtn = crtDir + "/crtn.o", libDir = "-L" + crtDir;
+    std::string crtbegin = gccLibDir + "/crtbegin.o", crtend = gccLibDir + "/crtend.o",
+                gccLibDirFlag = "-L" + gccLibDir;
+    std::vector<const char *> args = {
+        "ld.lld",
+        "-o", output.c_str(),
+        "--eh-frame-hdr",
+        "-dynamic-linker", XSTR(DYNLINKER),
+        crt1.c_str(), crti.c_str(), crtbegin.c_str(),
+        gccLibDirFlag.c_str(), libDir.c_str(),
+        objectPath.c_str()
+    };
+    for (auto &o : objects)
+        args.push_back(o.c_str());
+    args.insert(args.end(), {
+        XSTR(LIBLLAMA),
+#ifdef LIBGC
+        XSTR(LIBGC),
+#endif // LIBGC
+        "-lgcc", "--as-needed", "-lgcc_s", "--no-as-needed",
+        "-lc",
+        "-lgcc", "--as-needed", "-lgcc_s", "--no-as-needed",
+        crtend.c_str(), crtn.c_str()
+    });
+
+    bool linked = lld::elf::link(args, false, llvm::outs(), llvm::errs());
+    close(fd);
+    return linked;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <llvm/ADT/ArrayRef.h>
+
+/** Links an object file held in memory with the llama runtime library and
+ * libgc into the executable output, using the embedded lld
+ * @param objects Paths of further objects, e.g. the cached fragments
+ * @return true on success, diagnostics are printed by the linker */
+bool linkExecutable(llvm::ArrayRef<char> object, std::string output,
+                    const std::vector<std::string> &objects = {});
@@ -6,7 +6,11 @@
  * 
  * Every node is passed the name of the function definition
  * inside which it exists so that it can add external dependencies
- * to the function.
+ * to the function. Uses have been bound to their definitions,
+ * and scopes numbered, by resolve.
+ *
+ * Calls by name are bound to the function they call, while any other
+ * use of a function marks it escaping: only those need a trampoline.
  */
 
 int LivenessEntry::getScope()
@@ -21,6 +25,22 @@ bool LivenessEntry::isVisited()
 {
     return visited;
 }
+void LivenessEntry::setSymbolTypeGraph(TypeGraph *t)
+{
+    symbolTypeGraph = t;
+}
+TypeGraph *LivenessEntry::getSymbolTypeGraph()
+{
+    return symbolTypeGraph;
+}
+void LivenessEntry::setValue(llvm::Value *v)
+{
+    value = v;
+}
+llvm::Value *LivenessEntry::getValue()
+{
+    return value;
+}
 LivenessEntry::LivenessEntry(int scope)
     : scope(scope) {}
 LivenessEntryDef::LivenessEntryDef(int scope, Def *symbolDef)
@@ -49,19 +69,19 @@ PatternId* LivenessEntryPatternId::getNode()
     return symbolPatternId;
 }
 
-std::string LivenessEntryDef::getId()
+Symbol LivenessEntryDef::getId()
 {
     return symbolDef->getId();
 }
-std::string LivenessEntryPar::getId()
+Symbol LivenessEntryPar::getId()
 {
     return symbolPar->getId();
 }
-std::string LivenessEntryFor::getId()
+Symbol LivenessEntryFor::getId()
 {
     return symbolFor->getId();
 }
-std::string LivenessEntryPatternId::getId()
+Symbol LivenessEntryPatternId::getId()
 {
     return symbolPatternId->getId();
 }
@@ -83,140 +103,30 @@ TypeGraph* LivenessEntryPatternId::getTypeGraph()
     return symbolPatternId->getTypeGraph();
 }
 
-/** @param T is the Type the table will will hold pointers of */
-template <class T>
-class LivenessTable
+// Check whether this definition belongs to f's scope
+void checkScopeAndAddExternal(LivenessEntry *definition, Function *f)
 {
-    std::vector<std::map<std::string, T> *> *table;
-    bool nameInScope(std::string name, std::map<std::string, T> *scope)
-    {
-        return (scope->find(name) != scope->end());
-    }
-
-public:
-    LivenessTable() : table(new std::vector<std::map<std::string, T> *>())
-    {
-        openScope(); // open first (global) scope
-    }
-    /** Can be called with the implicit pair constructor
-     * e.g.: insert({"a_name", a_pointer})
-    */
-    void insert(std::pair<std::string, T> entry)
-    {
-        (*table->back())[entry.first] = entry.second;
-    }
-    T operator[](std::string name)
+    // Library functions and imports are never captured
+    if (!definition)
     {
-        for (auto it = table->rbegin(); it != table->rend(); it++)
-        {
-            if (nameInScope(name, *it))
-                return (**it)[name];
-        }
-        return nullptr;
-    }
-    void openScope()
-    {
-        table->push_back(new std::map<std::string, T>());
-    }
-    void closeScope()
-    {
-        if (table->size() != 0)
-        {
-            std::map<std::string, T> *poppedScope = table->back();
-            table->pop_back();
-            delete poppedScope;
-        }
-    }
-    int getCurrScope()
-    {
-        return (table->size() - 1);
+        return;
     }
-    ~LivenessTable() {}
-};
 
-LivenessTable<LivenessEntry *> LTable;
-
-void insertLibraryToLTable()
-{
-    // Library function names
-    std::vector<std::string> libraryFunc = 
-    {
-        "print_int", "print_bool", "print_char", "print_float", "print_string",
-        "read_int", "read_bool", "read_char", "read_float", "read_string",  
-        "abs", "fabs", "sqrt", "sin", "cos", "tan", "atan", "exp", "ln", "pi",
-        "incr", "decr",
-        "float_of_int", "int_of_float", "round", "int_of_char", "char_of_int",
-        "strlen", "strcmp", "strcpy", "strcat"
-    };
-
-    // Insert library functions
-    for(auto name: libraryFunc)
+    if (!(f->getScope() < definition->getScope()))
     {
-        LTable.insert({name, new LivenessEntryDef(0, nullptr)});
+        f->addExternal(definition);
     }
 }
-int getCurrScope()
-{
-    return LTable.getCurrScope();
-}
-int getScopeOf(std::string name)
-{
-    LivenessEntry *l = LTable[name];
-    return l->getScope();
-}
-int isInScopeOf(std::string id, Function *func)
-{
-    int idScope = getScopeOf(id);
-    int funcScope = (func == nullptr) ? 0 : func->getScope();
-
-    return (funcScope < idScope);
-}
-void openScopeOnLTable()
-{
-    LTable.openScope();
-}
-void closeScopeOnLTable()
-{
-    LTable.closeScope();
-}
-
-void insertDefToLTable(Def *d)
-{
-    int scope = LTable.getCurrScope();
-    LTable.insert({d->getId(), new LivenessEntryDef(scope, d)});
-}
-void insertParToLTable(Par *p)
-{
-    int scope = LTable.getCurrScope();
-    LTable.insert({p->getId(), new LivenessEntryPar(scope, p)});
-}
-void insertForToLTable(For *f)
-{
-    int scope = LTable.getCurrScope();
-    LTable.insert({f->getId(), new LivenessEntryFor(scope, f)});
-}
-void insertPatternIdToLTable(PatternId *p)
-{
-    int scope = LTable.getCurrScope();
-    LTable.insert({p->getId(), new LivenessEntryPatternId(scope, p)});
-}
 
-LivenessEntry *lookupSymbolOnLTable(std::string name)
-{
-    return LTable[name];
-}
-void makeVisitedOnLTable(std::string func)
+// @return The function definition is of, nullptr if it is not a function
+Function *definedFunction(LivenessEntry *definition)
 {
-    LTable[func]->visit();
-}
-
-// Check whether this name belongs to prevFunc's scope
-void checkScopeAndAddExternal(std::string name, Function *f)
-{
-    if(!isInScopeOf(name, f))
+    if (!definition)
     {
-        f->addExternal(lookupSymbolOnLTable(name));        
+        return nullptr;
     }
+
+    return dynamic_cast<Function *>(definition->getNode());
 }
 
 /*******************************************************/
@@ -233,9 +143,6 @@ void AST::addFunctionThatNeedsSymbol(Function *f)
 
 void Program::liveness(Function *prevFunc)
 {
-    // Add library functions once
-    insertLibraryToLTable();
-
     // Recursive call using nullptr as function
     for (auto *d : definition_list)
     {
@@ -246,20 +153,10 @@ void Letdef::liveness(Function *prevFunc)
 {
     if (recursive)
     {
-        // Insert functions to table
-        for(auto *d: def_list)
-        {
-            if(d->isDef())
-            {
-                insertDefToLTable(dynamic_cast<Def *>(d));
-            } 
-        }
-
-        // Call liveness on each def and make them visited
+        // Call liveness on each def
         for(auto *d: def_list)
         {
             d->liveness(prevFunc);
-            makeVisitedOnLTable(d->getId());
         }
 
         /*
@@ -287,17 +184,6 @@ void Letdef::liveness(Function *prevFunc)
         {
             d->liveness(prevFunc);
         }
-
-        // Insert symbols to table and make them visited
-        for(auto *d: def_list)
-        {
-            if(d->isDef())
-            {
-                insertDefToLTable(dynamic_cast<Def *>(d));
-            } 
-
-            makeVisitedOnLTable(d->getId());        
-        }
     }
 }
 
@@ -329,7 +215,7 @@ void Function::addExternal(LivenessEntry *l)
         return;
     }
 
-    std::string id = l->getId();
+    Symbol id = l->getId();
 
     // Only add it if it hasn't already been added
     if(external.find(id) == external.end()) 
@@ -359,10 +245,49 @@ void insertExternalToFrom(Function *funcDependent, Function *func)
     
     //funcDependent->external.insert(func->external.begin(), func->external.end());
 }
-std::map<std::string, LivenessEntry *> Function::getExternal()
+const std::map<Symbol, LivenessEntry *, SymbolNameLess> &Function::getExternal()
 {
     return external;
 }
+void Function::markEscaping()
+{
+    escapes = true;
+}
+bool Function::isEscaping()
+{
+    return escapes;
+}
+// More are better kept in an environment than in registers
+static const std::size_t maxLiftedExternals = 4;
+bool Function::isLifted()
+{
+    if (escapes)
+    {
+        return false;
+    }
+
+    // Any other function that needs it would need what it captures too
+    for (auto *f : listOfFunctionsThatNeedSymbol)
+    {
+        if (f != this)
+        {
+            return false;
+        }
+    }
+
+    // Calls to itself pass on what it captures, it needs no value of its own
+    std::size_t captured = external.size();
+    auto self = external.find(id);
+    if (self != external.end() && self->second == entry)
+    {
+        captured--;
+    }
+    return captured <= maxLiftedExternals;
+}
+void Function::markSelfTailCall()
+{
+    selfTailCalls = true;
+}
 void Function::setScope(int s)
 {
     scope = s;
@@ -373,28 +298,14 @@ int Function::getScope()
 }
 void Function::liveness(Function *prevFunc)
 {
-    // Save scope of function
-    scope = getCurrScope();
-
-    // Create new scope
-    openScopeOnLTable();
-
-    // Insert parameters to table
-    for(auto p: par_list)
-    {
-        insertParToLTable(p);
-    }
-    
     // Recursive call to the body passing this function
     expr->liveness(this);
+    expr->markTailCalls(this);
     
     if(prevFunc)
     {
         insertExternalToFrom(prevFunc, this);
     }
-
-    // Close scope
-    closeScopeOnLTable();
 }
 
 void LetIn::liveness(Function *prevFunc)
@@ -419,19 +330,10 @@ void While::liveness(Function *prevFunc)
 }
 void For::liveness(Function *prevFunc)
 {
-    // Open scope
-    openScopeOnLTable();
-
-    // Insert node to table
-    insertForToLTable(this);
-
     // Recursive calls
     start->liveness(prevFunc);
     finish->liveness(prevFunc);
     body->liveness(prevFunc);
-
-    // Close scope
-    closeScopeOnLTable();
 }
 void If::liveness(Function *prevFunc)
 {
@@ -447,7 +349,7 @@ void Dim::liveness(Function *prevFunc)
     if(!prevFunc) return;
 
     // Check whether this array belongs to prevFunc's scope
-    checkScopeAndAddExternal(id, prevFunc);
+    checkScopeAndAddExternal(definition, prevFunc);
 }
 void ArrayAccess::liveness(Function *prevFunc)
 {
@@ -460,14 +362,20 @@ void ArrayAccess::liveness(Function *prevFunc)
     if(!prevFunc) return;
 
     // Check whether this array belongs to prevFunc's scope
-    checkScopeAndAddExternal(id, prevFunc);
+    checkScopeAndAddExternal(definition, prevFunc);
 }
 void ConstantCall::liveness(Function *prevFunc)
 {
+    // The function is used as a value
+    if (Function *func = definedFunction(definition))
+    {
+        func->markEscaping();
+    }
+
     if(!prevFunc) return;
 
     // Check whether this constant belongs to prevFunc's scope
-    checkScopeAndAddExternal(id, prevFunc);
+    checkScopeAndAddExternal(definition, prevFunc);
 }
 void ConstructorCall::liveness(Function *prevFunc)
 {
@@ -484,13 +392,17 @@ void FunctionCall::liveness(Function *prevFunc)
         e->liveness(prevFunc);
     }
 
+    // Bind the call to the function it calls, if it is not a parameter,
+    // a library function or a value of function type
+    f = definedFunction(definition);
+
     if(!prevFunc) 
     {
         return;
     }
     
     // Check whether this function belongs to prevFunc's scope
-    checkScopeAndAddExternal(id, prevFunc);
+    checkScopeAndAddExternal(definition, prevFunc);
 }
 
 void Match::liveness(Function *prevFunc)
@@ -504,24 +416,53 @@ void Match::liveness(Function *prevFunc)
 }
 void Clause::liveness(Function *prevFunc)
 {
-    // Open scope
-    openScopeOnLTable();
-
-    pattern->liveness(prevFunc);
     expr->liveness(prevFunc);
+}
+
+/*******************************************************/
+
+/*
+ * Calls in tail position are the last thing the body of a function does,
+ * their result is its result. Only the body itself is followed, functions
+ * defined in it mark their own.
+ */
 
-    // Close scope
-    closeScopeOnLTable();
+// By default nothing in it is in tail position
+void AST::markTailCalls(Function *f)
+{
+    return;
+}
+void LetIn::markTailCalls(Function *f)
+{
+    expr->markTailCalls(f);
+}
+void BinOp::markTailCalls(Function *f)
+{
+    // && and || combine their operands after evaluating them
+    if (op == ';')
+        rhs->markTailCalls(f);
 }
-void PatternConstr::liveness(Function *prevFunc)
+void If::markTailCalls(Function *f)
 {
-    for (const auto &pattern: pattern_list)
+    body->markTailCalls(f);
+
+    if (else_body != nullptr)
+        else_body->markTailCalls(f);
+}
+void FunctionCall::markTailCalls(Function *f)
+{
+    tailOf = f;
+    if (this->f == f)
+        f->markSelfTailCall();
+}
+void Match::markTailCalls(Function *f)
+{
+    for (auto *c : clause_list)
     {
-        pattern->liveness(prevFunc);
+        c->markTailCalls(f);
     }
 }
-void PatternId::liveness(Function *prevFunc)
+void Clause::markTailCalls(Function *f)
 {
-    // Insert to table
-    insertPatternIdToLTable(this);
-}
\ No newline at end of file
+    expr->markTailCalls(f);
+}
@@ -1,5 +1,8 @@
 #include "options.hpp"
 
+#define XSTR(s) STR(s)
+#define STR(s) #s
+
 int LongOption::count = 130; // so that it doesn't hit any ascii codes
 OptionList optionList;
 
@@ -52,11 +55,22 @@ struct option LongOption::getStructOption()
 
 LongOption 
     // Main options
-    optimise("O", "Produces code and runs optimisations on it"),
+    optimise("O", "Same as -O1"),
+    optimiseNone("O0", "Produces code without optimisations (default)"),
+    optimiseLess("O1", "Optimises with LLVM's -O1 module pipeline"),
+    optimiseDefault("O2", "Optimises with LLVM's -O2 module pipeline, user functions are internalized"),
+    optimiseAggressive("O3", "Optimises with LLVM's -O3 module pipeline, user functions are internalized"),
     llvmIR("i", "Prints LLVM IR code"),
     printObjectCode("f", "Prints object code"),
     printAssemblyCode("S", "Prints assembly code"),
     outputFile("o", "Prints output to file specified", required_argument),
+    run("run", "Runs the program right away with the JIT instead of producing an executable"),
+    targetCPU("mcpu", "Generates code for the given CPU, e.g. -mcpu=skylake", required_argument),
+    targetAttributes("mattr", "Enables or disables target features, e.g. -mattr=+avx2,-fma", required_argument),
+    targetArch("march", "-march=native generates code for the host CPU and all its features", required_argument),
+    module("module", "Compiles a module to an object (-o, default file.o) and its interface file.lli, with no main"),
+    use("use", "Uses the modules of the interfaces given, e.g. -use=lists.lli,trees.lli, linking their objects", required_argument),
+    closures("closures", "Representation of function values, trampoline (default) or fat: {code, environment} pairs that need no executable heap", required_argument),
 
     // Auxiliary options for debug
     ast("ast", "Prints the whole AST produced by the syntactical analysis"),
@@ -67,6 +81,23 @@ LongOption
     
     // Options that allow the user to directly instruct the frontend
     frontend("frontend", "Controls the frontend and takes arguments syntax, sem, inf, compile", required_argument),
+
+    // Batch compilation
+    batch("batch", "Compiles all files given, each to its own output (-o names the output directory)"),
+    jobs("j", "Number of files compiled in parallel in batch mode (default: number of cores)", required_argument),
+
+    // Compile server
+    serve("serve", "Runs a compile server for llamac-client on a Unix socket (-serve=path, default $LLAMAC_SOCKET or " LLAMAC_DEFAULT_SOCKET_HELP ")", optional_argument),
+
+    // Compilation cache
+    cache("cache", "Reuses executables and object files compiled before from the same source and options"),
+    cacheDir("cache-dir", "Directory of the cache (default $LLAMAC_CACHE_DIR or ~/.cache/llamac)", required_argument),
+    cacheMaxSize("cache-max-size", "Size bound of the cache in MB, least recently used entries are evicted (default 1024)", required_argument),
+    cacheStats("cache-stats", "Prints cache statistics and exits"),
+    incremental("incremental", "Keeps an object per top-level definition in the cache directory and only recompiles those that changed"),
+
+    // Profiling
+    timePhases("time-phases", "Reports time and peak memory of each compilation phase to stderr (-time-phases=json for JSON)", optional_argument),
     
     // Help
     help("help", "Shows all options and their funcionality");
@@ -103,7 +134,7 @@ void OptionList::parseOptions(int argc, char **argv)
         exit(1);
     }
 
-    // Take the input file (might be -help but will exit before freopen)
+    // Take the input file (might be -help but will exit before opening it)
     std::string filename = std::string(argv[1]);
 
     // Parse given options
@@ -132,7 +163,7 @@ void OptionList::parseOptions(int argc, char **argv)
     // Print help message and exit immediately
     if (help.isActivated())
     {
-        std::cout << "Usage ./llamac file [options]" << std::endl;
+        std::cout << "Usage ./llamac file [options] (file can be - for stdin)" << std::endl;
         std::cout << std::endl;
         std::cout << "Options:\n";
 
@@ -144,13 +175,70 @@ void OptionList::parseOptions(int argc, char **argv)
         }
 
         std::cout << std::endl;
-        std::cout << "Compiler might use files a.{ll, o, out} in which case they will be truncated" << std::endl;
+        std::cout << "Compiler might use files a.{o, out} in which case they will be truncated" << std::endl;
+        std::cout << "In batch mode outputs are named after each input, e.g. file.lla -> file.out" << std::endl;
         std::cout << std::endl;
         exit(0);
     }
     
-    // Redirect stdin
-    if(std::freopen(filename.c_str(), "r", stdin) == nullptr) 
+    if (timePhases.isActivated())
+    {
+        if (timePhases.getOptarg() != "" && timePhases.getOptarg() != "json")
+        {
+            std::cerr << "Argument \"" << timePhases.getOptarg() << "\" passed to time-phases is invalid" << std::endl;
+            exit(1);
+        }
+        phaseTimer.enable();
+    }
+
+    if (cache.isActivated() || cacheStats.isActivated())
+    {
+        unsigned long long maxMB = 1024;
+        if (cacheMaxSize.isActivated())
+            maxMB = std::strtoull(cacheMaxSize.getOptarg().c_str(), nullptr, 10);
+        compileCache.enable(cacheDir.isActivated() ? cacheDir.getOptarg() : CompileCache::defaultDir(),
+                            maxMB * 1024 * 1024);
+    }
+    if (cacheStats.isActivated())
+    {
+        compileCache.printStats(std::cout);
+        exit(0);
+    }
+
+    if (serve.isActivated())
+        return;
+
+    if (batch.isActivated())
+    {
+        // getopt has moved every non-option argument to the end
+        for (int i = optind; i < argc; i++)
+            inputFiles.push_back(std::string(argv[i]));
+        if (inputFiles.empty())
+        {
+            std::cerr << "No input files given to -batch" << std::endl;
+            exit(1);
+        }
+        return;
+    }
+
+    openInput(filename);
+}
+void OptionList::openInput(std::string filename)
+{
+    inputFile = filename;
+
+    // Source given in memory (compile server) stands for stdin
+    if (filename == "-")
+    {
+        if (!inputSource.isLoaded() && !inputSource.readFd(STDIN_FILENO))
+        {
+            std::cerr << "Couldn't read source from stdin" << std::endl;
+            exit(1);
+        }
+        return;
+    }
+
+    if (!inputSource.mapFile(filename))
     {
         std::cerr << "Couldn't open file " << filename << std::endl;
         exit(1);
@@ -199,8 +287,21 @@ void OptionList::executeOptions()
     }
     else 
     {
-        syntax = sem = inference = compile = link = true;
+        syntax = sem = inference = compile = true;
+        link = !run.isActivated() && !module.isActivated();
+    }
+    if (run.isActivated() && use.isActivated())
+    {
+        std::cerr << "-run can't be used with -use, link an executable instead" << std::endl;
+        exit(1);
     }
+    // Known before interfaces are read, as their values must match
+    if (closures.isActivated() && closures.getOptarg() != "fat" && closures.getOptarg() != "trampoline")
+    {
+        std::cerr << "Argument \"" << closures.getOptarg() << "\" passed to closures is invalid, use fat or trampoline" << std::endl;
+        exit(1);
+    }
+    AST::setFatClosures(closures.getOptarg() == "fat");
 
     if (inferenceLogs.isActivated())
     {
@@ -224,11 +325,24 @@ void OptionList::executeOptions()
     }
     if (sem)
     {
+        phaseTimer.start("resolve");
+        if (use.isActivated())
+        {
+            loadInterfaces(use.getOptarg());
+            insertUsedModulesToSymbolTable();
+        }
+        p->resolve();
+        phaseTimer.stop();
+
+        phaseTimer.start("sem");
         p->sem();
+        phaseTimer.stop();
     }
     if (inference)
     {
+        phaseTimer.start("inference");
         bool infSuccess = inf.solveAll(false);
+        phaseTimer.stop();
         if (idTypes.isActivated())
         {
             //printHeader("Types of identifiers");
@@ -241,10 +355,55 @@ void OptionList::executeOptions()
     }
     if (compile)
     {   
+        phaseTimer.start("liveness");
         p->liveness(nullptr); 
+        phaseTimer.stop();
         
-        bool opt = optimise.isActivated();
+        int opt = optimizationLevel();
+        phaseTimer.start("irgen");
+        std::string cpu = "generic", features = "";
+        if (targetArch.isActivated())
+        {
+            if (targetArch.getOptarg() != "native")
+            {
+                std::cerr << "Argument \"" << targetArch.getOptarg() << "\" passed to march is invalid, use -mcpu instead" << std::endl;
+                exit(1);
+            }
+            cpu = "native";
+        }
+        if (targetCPU.isActivated())
+            cpu = targetCPU.getOptarg();
+        if (targetAttributes.isActivated())
+            features = targetAttributes.getOptarg();
+        AST::setTarget(cpu, features);
+
+        std::string objectPath = "";
+        if (module.isActivated())
+        {
+            if (filename == "" && inputFile == "-")
+            {
+                std::cerr << "A module read from stdin needs -o" << std::endl;
+                exit(1);
+            }
+            objectPath = filename != "" ? filename : batchOutputPath(inputFile);
+            AST::setModule(moduleNameOf(objectPath));
+        }
+
+        // Only executables are put together from fragments
+        if (incremental.isActivated() && link)
+        {
+            unsigned long long maxMB = 1024;
+            if (cacheMaxSize.isActivated())
+                maxMB = std::strtoull(cacheMaxSize.getOptarg().c_str(), nullptr, 10);
+            fragmentCache.enable((cacheDir.isActivated() ? cacheDir.getOptarg() : CompileCache::defaultDir()) + "/fragments",
+                                 maxMB * 1024 * 1024);
+            phaseTimer.start("fingerprint");
+            p->planFragments("fragment" + codegenOptions() + usedModulesSignature());
+            phaseTimer.stop();
+        }
+
         p->start_compilation("module.ll", opt);
+        phaseTimer.stop();
         
         if (llvmIR.isActivated())
         {
@@ -252,47 +411,290 @@ void OptionList::executeOptions()
         }
         if (printAssemblyCode.isActivated())
         {
+            phaseTimer.start("codegen");
             p->emitAssemblyCode();
+            phaseTimer.stop();
         }
         if (printObjectCode.isActivated())
         {
+            phaseTimer.start("codegen");
             if(filename == "")
                 p->emitObjectCode("a.o");
             else
                 p->emitObjectCode(filename.c_str());
+            phaseTimer.stop();
+            compileCache.store(filename == "" ? "a.o" : filename);
+        }
+        if (module.isActivated())
+        {
+            phaseTimer.start("codegen");
+            p->emitObjectCode(objectPath.c_str());
+            phaseTimer.stop();
+            p->writeInterface(interfacePathOf(objectPath), objectPath);
         }
     }
+    if (compile && run.isActivated())
+        exit(AST::runInJIT());
     if (link)
     {
-        if(! printObjectCode.isActivated()) 
-        {
-            p->emitObjectCode("a.o");
-        }
+        // The object never touches the disk, only the executable is written
+        llvm::SmallVector<char, 0> object;
+        phaseTimer.start("codegen");
+        p->emitObjectCode(object);
+        phaseTimer.stop();
+        phaseTimer.start("link");
+        std::vector<std::string> objects = usedModuleObjects(), fragmentObjs = fragmentObjects();
+        objects.insert(objects.end(), fragmentObjs.begin(), fragmentObjs.end());
+        bool linked = linkExecutable(object, filename == "" ? "a.out" : filename, objects);
+        phaseTimer.stop();
+        if (!linked)
+            exit(1);
+        // Not before linking, as the fragments of this program might go
+        if (fragmentCache.isEnabled())
+            fragmentCache.evict();
+        compileCache.store(filename == "" ? "a.out" : filename);
+    }
+}
+bool OptionList::loadFromCache()
+{
+    if (!compileCache.isEnabled())
+        return false;
 
-#define XSTR(s) STR(s)
-#define STR(s) #s
-        std::string linkCommand = 
-                std::string("clang -o ") + 
-                (filename == "" ? "a.out" : filename.c_str()) + std::string(" ") +
-                "a.o " + 
-#ifdef LIBLLAMA
-                std::string(XSTR(LIBLLAMA)) +
-#else
-#error Location of llama runtime library must be specified
-#endif // LIBLLAMA
-                " " +
+    // Only runs whose sole product is an executable or object file
+    bool linking = !frontend.isActivated();
+    bool objectOnly = frontend.getOptarg() == "compile" && printObjectCode.isActivated();
+    // Modules and their users depend on other files than the source
+    if (module.isActivated() || use.isActivated())
+        return false;
+    if (!(linking || objectOnly) || run.isActivated() || llvmIR.isActivated() ||
+        printAssemblyCode.isActivated() || ast.isActivated() || idTypes.isActivated() ||
+        inferenceLogs.isActivated() || tableLogs.isActivated())
+        return false;
+
+    std::string options = std::string(linking ? "exe" : "obj") + codegenOptions();
+    std::string output = outputFile.isActivated() ? outputFile.getOptarg() : 
+                         linking ? "a.out" : "a.o";
+    return compileCache.fetch(inputSource.text(), options, output);
+}
+int OptionList::optimizationLevel()
+{
+    // The highest level given wins
+    int opt = 0;
+    if (optimise.isActivated() || optimiseLess.isActivated())
+        opt = 1;
+    if (optimiseDefault.isActivated())
+        opt = 2;
+    if (optimiseAggressive.isActivated())
+        opt = 3;
+    return opt;
+}
+std::string OptionList::codegenOptions()
+{
+    // Everything that changes the produced code, the libraries linked in
+    // by their contents as they may be rebuilt in place
+    std::string cpu = targetArch.isActivated() || targetCPU.getOptarg() == "native" ? 
+        "native:" + llvm::sys::getHostCPUName().str() : "";
+    return
+        " O" + std::to_string(optimizationLevel()) +
+        " mcpu=" + (targetCPU.isActivated() ? targetCPU.getOptarg() : "") + cpu +
+        " mattr=" + targetAttributes.getOptarg() +
+        " closures=" + (closures.getOptarg() == "fat" ? "fat" : "trampoline") +
 #ifdef LIBGC
-                std::string(XSTR(LIBGC));
+        " gc=" + CompileCache::fileDigest(XSTR(LIBGC)) +
 #else
-                std::string("");
+        " gc=none" +
 #endif // LIBGC
-        if(std::system(linkCommand.c_str()))
-            exit(1);
+        " runtime=" + CompileCache::fileDigest(XSTR(LIBLLAMA));
+}
+void OptionList::reportPhases()
+{
+    if (!phaseTimer.isEnabled() || phasesReported)
+        return;
+    phasesReported = true;
+    phaseTimer.stopAll();
+    if (timePhases.getOptarg() == "json")
+        phaseTimer.printJSON(std::cerr);
+    else
+        phaseTimer.printTable(std::cerr);
+}
+void OptionList::resetOptions()
+{
+    for (auto l : longOptions)
+    {
+        l->deactivate();
+        l->setOptarg("");
+    }
+    inputFiles.clear();
+    phasesReported = false;
+    optind = 0; // makes getopt start over
+}
+bool OptionList::isServer()
+{
+    return serve.isActivated();
+}
+std::string OptionList::getServerSocket()
+{
+    return serve.getOptarg() == "" ? defaultSocketPath() : serve.getOptarg();
+}
+bool OptionList::isRun()
+{
+    return run.isActivated();
+}
+bool OptionList::isBatch()
+{
+    return batch.isActivated();
+}
+std::string OptionList::batchOutputPath(std::string input)
+{
+    // file.lla -> <-o directory or input's directory>/file.<ext>
+    std::string stem = input, dir = "";
+    std::size_t slash = stem.find_last_of('/');
+    if (slash != std::string::npos)
+    {
+        dir = stem.substr(0, slash + 1);
+        stem = stem.substr(slash + 1);
+    }
+    std::size_t dot = stem.find_last_of('.');
+    if (dot != std::string::npos && dot != 0)
+        stem = stem.substr(0, dot);
+    if (outputFile.isActivated())
+        dir = outputFile.getOptarg() + "/";
 
-        if(!printObjectCode.isActivated()) 
+    std::string ext = ".txt";
+    if (!frontend.isActivated())
+        ext = module.isActivated() ? ".o" : ".out";
+    else if (printObjectCode.isActivated())
+        ext = ".o";
+    else if (printAssemblyCode.isActivated())
+        ext = ".s";
+    else if (llvmIR.isActivated())
+        ext = ".ll";
+    return dir + stem + ext;
+}
+int OptionList::runBatch(int (*compileInput)())
+{
+    struct Job
+    {
+        std::string input;
+        FILE *log; // stderr of the worker, open while it runs
+        std::string diagnostics; // what it wrote there, kept if it failed or timed its phases
+        std::chrono::steady_clock::time_point start;
+        double millis = 0;
+        int status = 0;
+    };
+    std::vector<Job> batchJobs;
+    for (auto &f : inputFiles)
+        batchJobs.push_back({f, nullptr, "", {}});
+
+    long maxJobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs.isActivated())
+        maxJobs = std::atol(jobs.getOptarg().c_str());
+    if (maxJobs < 1)
+        maxJobs = 1;
+
+    auto batchStart = std::chrono::steady_clock::now();
+    std::map<pid_t, Job *> running;
+    std::size_t next = 0;
+    while (next < batchJobs.size() || !running.empty())
+    {
+        while (next < batchJobs.size() && (long)running.size() < maxJobs)
         {
-            if(std::system("rm a.o"))
+            Job &job = batchJobs[next++];
+            job.log = std::tmpfile();
+            // Nothing the worker runs needs it, it writes to it as stderr
+            if (job.log)
+                fcntl(fileno(job.log), F_SETFD, FD_CLOEXEC);
+            job.start = std::chrono::steady_clock::now();
+            std::cout.flush();
+            std::cerr.flush();
+            std::fflush(nullptr);
+            pid_t pid = fork();
+            if (pid == -1)
+            {
+                std::cerr << "Couldn't start worker for " << job.input << std::endl;
                 exit(1);
+            }
+            if (pid == 0)
+            {
+                // The worker owns a fresh copy of the (still empty) frontend state
+                if (job.log)
+                    dup2(fileno(job.log), STDERR_FILENO);
+                // The logs of the others stay with the parent
+                for (auto &other : running)
+                {
+                    if (other.second->log)
+                        std::fclose(other.second->log);
+                }
+                // Before -o is overwritten, it is the directory of the outputs
+                std::string output = batchOutputPath(job.input);
+                outputFile.activate();
+                outputFile.setOptarg(output);
+                openInput(job.input);
+                int result = compileInput();
+                std::fflush(nullptr);
+                exit(result);
+            }
+            running[pid] = &job;
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+        if (pid == -1)
+            break;
+        auto it = running.find(pid);
+        if (it == running.end())
+            continue;
+        Job &job = *it->second;
+        job.millis = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - job.start).count();
+        job.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        running.erase(it);
+        // Logs are closed as workers finish, so that as many are open as running jobs
+        if (job.log)
+        {
+            if (job.status != 0 || timePhases.isActivated())
+            {
+                std::rewind(job.log);
+                char buf[4096];
+                std::size_t n;
+                while ((n = std::fread(buf, 1, sizeof(buf), job.log)) > 0)
+                    job.diagnostics.append(buf, n);
+            }
+            std::fclose(job.log);
+            job.log = nullptr;
+        }
+    }
+    double totalMillis = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - batchStart).count();
+
+    // Diagnostics of failed jobs (and phase reports with -time-phases)
+    // first, then the summary table
+    int failed = 0;
+    for (auto &job : batchJobs)
+    {
+        if (job.status != 0)
+            failed++;
+        if (job.status != 0 || job.diagnostics != "")
+        {
+            std::cerr << "==> " << job.input << " <==" << std::endl
+                      << job.diagnostics;
         }
     }
+
+    std::cout << std::left << std::setw(10) << "status"
+              << std::right << std::setw(12) << "time (ms)" << "  "
+              << std::left << "file" << std::endl;
+    for (auto &job : batchJobs)
+    {
+        std::string status = job.status == 0 ? "ok" : 
+                             job.status > 128 ? "crashed" : "failed";
+        std::cout << std::left << std::setw(10) << status
+                  << std::right << std::setw(12) << std::fixed << std::setprecision(1) << job.millis << "  "
+                  << std::left << job.input << std::endl;
+    }
+    std::cout << batchJobs.size() - failed << " succeeded, " << failed << " failed in "
+              << std::fixed << std::setprecision(1) << totalMillis << " ms using "
+              << maxJobs << " jobs" << std::endl;
+
+    return failed ? 1 : 0;
 }
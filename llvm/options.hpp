@@ -9,10 +9,23 @@
 #include <iomanip>
 #include <string>
 #include <vector>
+#include <map>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "ast.hpp"
 #include "infer.hpp"
 #include "symbol.hpp"
+#include "link.hpp"
+#include "timing.hpp"
+#include "protocol.hpp"
+#include "cache.hpp"
+#include "incremental.hpp"
+#include "interface.hpp"
+#include "source.hpp"
+#include <llvm/Support/Host.h>
 
 class Option
 {
@@ -62,6 +75,21 @@ protected:
 
     // Will be filled by setProgram called by yyparse
     Program *p;
+
+    // Input files of a batch run, filled by parseOptions
+    std::vector<std::string> inputFiles;
+
+    // Set by openInput, "-" when the source is read from stdin
+    std::string inputFile = "";
+
+    // Phases are reported once, whichever way the compilation ends
+    bool phasesReported = false;
+
+    void openInput(std::string filename);
+    std::string batchOutputPath(std::string input);
+    int optimizationLevel();
+    /** Every option that affects the generated code, in a canonical form */
+    std::string codegenOptions();
 public:
     OptionList();
     void addShortOption(ShortOption *s);
@@ -70,6 +98,19 @@ public:
     void parseOptions(int argc, char **argv);
     void setProgram(Program *p);
     void executeOptions();
+    /** Prints the -time-phases report, once. Also called at exit */
+    void reportPhases();
+    /** Forgets all options given, before parsing those of a server request */
+    void resetOptions();
+    /** Looks the compilation up in the cache (-cache), writing its output on a hit */
+    bool loadFromCache();
+    bool isServer();
+    std::string getServerSocket();
+    bool isRun();
+    bool isBatch();
+    /** Compiles every input file in a forked worker, at most -j at a time.
+     * @param compileInput Runs the whole pipeline on inputSource, returns exit code */
+    int runBatch(int (*compileInput)());
 };
 
 extern OptionList optionList;
@@ -8,12 +8,19 @@
 #include "lexer.hpp"
 #include "ast.hpp"
 #include "options.hpp"
+#include "server.hpp"
 
 // #define YYERROR_VERBOSE 1 // comment out to disable verbose error report
 // #define YYDEBUG 1 // comment out to disable debug feature compilation
 %}
 /* %define parse.trace */
+%define api.pure full
 %define parse.error verbose
+%param {yyscan_t scanner}
+
+%code requires {
+#include "lexer.hpp"
+}
 %expect 24
 
 %union {
@@ -35,7 +42,7 @@
     std::vector<Type *> *type_vect;
     std::vector<Pattern *> *pat_vect;
     std::vector<Clause *> *clause_vect;
-    std::string *id;
+    Symbol id;  // Interned by the lexer
     int op;     // This will store the lexical code of the operator
     int num;
     // char character ! No need cause we need the string !
@@ -44,6 +51,10 @@
     
 }
 
+%code {
+int yylex(YYSTYPE *yylval, yyscan_t scanner);
+}
+
 %token T_and "and"
 %token T_array "array"
 %token T_begin "begin"
@@ -148,7 +159,7 @@
 
 %%
 program 
-: program_list                      { $$ = $1; optionList.setProgram($$); } 
+: program_list                      { $$ = $1; yyget_extra(scanner)->program = $$; } 
 ;
 
 program_list
@@ -392,24 +403,70 @@ pattern_list
 ;
 
 %%
-void yyerror(const char *msg) {
-    std::cerr <<  "Error at line " << yylineno << ": "
+void yyerror(yyscan_t scanner, const char *msg) {
+    std::cerr <<  "Error at line " << yyget_lineno(scanner) << ": "
               <<  msg << '\n';
     exit(1);
 }
 
-int main(int argc, char **argv) {
-    // Handle options
-    optionList.parseOptions(argc, argv);
+static void reportPhasesAtExit() {
+    optionList.reportPhases();
+}
+
+// Compiles the source opened by parseOptions (or runBatch)
+int compileInput() {
+    // -run and errors exit in the middle of the phases
+    static bool reportAtExit = std::atexit(reportPhasesAtExit) == 0;
+    (void)reportAtExit;
+
+    phaseTimer.start("cache lookup");
+    bool cached = optionList.loadFromCache();
+    phaseTimer.stop();
+    if (cached) {
+        optionList.reportPhases();
+        return 0;
+    }
+
+    // Everything the frontend allocates goes at once when this returns
+    ArenaScope arenas;
 
     // yydebug = 1; // default val is zero so just comment this to disable
-    int result = yyparse();
+    phaseTimer.start("parse");
+    ParseContext context(inputSource.scanBase(), inputSource.scanSize());
+    int result = yyparse(context.scanner);
+    phaseTimer.stop();
+    optionList.setProgram(context.program);
     
     // Run options
     optionList.executeOptions();
+    optionList.reportPhases();
 
     // Finish
     if (result == 0 && printSuccess.isActivated()) std::cout << "Success\n";
     
     return result;
+}
+
+// Runs in a process forked from the compile server for each request
+int compileRequest(int argc, char **argv) {
+    optionList.resetOptions();
+    optionList.parseOptions(argc, argv);
+    // The program would read the server's stdin, not the client's
+    if (optionList.isRun()) {
+        std::cerr << "-run can't be used through the server, link an executable instead" << std::endl;
+        return 1;
+    }
+    return compileInput();
+}
+
+int main(int argc, char **argv) {
+    // Handle options
+    optionList.parseOptions(argc, argv);
+
+    if (optionList.isServer())
+        return runServer(optionList.getServerSocket(), compileRequest);
+    if (optionList.isBatch())
+        return optionList.runBatch(compileInput);
+
+    return compileInput();
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 
 #include "ast.hpp"
 #include "parser.hpp"
@@ -10,6 +11,9 @@ const std::string type_string[] = {"unit", "int", "float", "bool", "char"};
 static int prefixSpaces = 0;
 const int indent = 2;
 
+// Set while printing for canonicalString
+static bool canonical = false;
+
 // Prints newline
 void createBlock(std::ostream &out)
 {
@@ -37,8 +41,21 @@ std::ostream &operator<<(std::ostream &out, const AST &t)
     return out;
 }
 
+std::string AST::canonicalString() const
+{
+    std::ostringstream out;
+    canonical = true;
+    printOn(out);
+    canonical = false;
+    return out.str();
+}
+
 std::string UnknownType::getTypeStr() const
 {
+    // Temporary names depend on everything inferred before,
+    // and there is none before sem
+    if (canonical || !TG)
+        return "unknown";
     return TG->stringifyTypeClean();
 }
 std::string BasicType::getTypeStr() const
@@ -61,7 +78,7 @@ std::string RefType::getTypeStr() const
 }
 std::string CustomType::getTypeStr() const
 {
-    return id;
+    return id.str();
 }
 
 void Type::printOn(std::ostream &out) const
@@ -256,7 +273,12 @@ void Bool_literal::printOn(std::ostream &out) const
 }
 void Float_literal::printOn(std::ostream &out) const
 {
-    printHeader(out, "Float_literal " + std::to_string(d));
+    std::ostringstream value;
+    if (canonical)
+        value << std::setprecision(17) << d;
+    else
+        value << std::to_string(d);
+    printHeader(out, "Float_literal " + value.str());
 
     createBlock(out);
     closeBlock(out);
@@ -0,0 +1,93 @@
+#include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "protocol.hpp"
+
+static bool writeAll(int fd, const void *data, std::size_t size)
+{
+    const char *p = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        ssize_t n = write(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+static bool readAll(int fd, void *data, std::size_t size)
+{
+    char *p = static_cast<char *>(data);
+    while (size > 0)
+    {
+        ssize_t n = read(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+static bool sendInt(int fd, std::uint32_t n)
+{
+    return writeAll(fd, &n, sizeof(n));
+}
+static bool recvInt(int fd, std::uint32_t &n)
+{
+    return readAll(fd, &n, sizeof(n));
+}
+static bool sendString(int fd, const std::string &s)
+{
+    return sendInt(fd, s.size()) && writeAll(fd, s.data(), s.size());
+}
+static bool recvString(int fd, std::string &s)
+{
+    std::uint32_t size;
+    if (!recvInt(fd, size))
+        return false;
+    s.resize(size);
+    return readAll(fd, &s[0], size);
+}
+
+bool sendRequest(int fd, const CompileRequest &req)
+{
+    if (!sendInt(fd, req.args.size()))
+        return false;
+    for (auto &arg : req.args)
+        if (!sendString(fd, arg))
+            return false;
+    return sendString(fd, req.cwd) && sendString(fd, req.source);
+}
+bool recvRequest(int fd, CompileRequest &req)
+{
+    std::uint32_t argc;
+    if (!recvInt(fd, argc))
+        return false;
+    req.args.resize(argc);
+    for (auto &arg : req.args)
+        if (!recvString(fd, arg))
+            return false;
+    return recvString(fd, req.cwd) && recvString(fd, req.source);
+}
+bool sendResponse(int fd, const CompileResponse &res)
+{
+    return sendInt(fd, res.status) && sendString(fd, res.out) && sendString(fd, res.err);
+}
+bool recvResponse(int fd, CompileResponse &res)
+{
+    std::uint32_t status;
+    if (!recvInt(fd, status))
+        return false;
+    res.status = status;
+    return recvString(fd, res.out) && recvString(fd, res.err);
+}
+std::string defaultSocketPath()
+{
+    if (const char *path = std::getenv("LLAMAC_SOCKET"))
+        return path;
+    if (const char *runtimeDir = std::getenv("XDG_RUNTIME_DIR"))
+        return std::string(runtimeDir) + "/llamac.sock";
+    return "/tmp/llamac-" + std::to_string(getuid()) + ".sock";
+}
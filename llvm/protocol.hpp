@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/* Wire format of the compile server, shared with llamac-client.
+ * Every string is sent as a 32-bit length followed by its bytes.
+ *   request:  argc, args..., working directory, source (empty to read args' file)
+ *   response: exit status, captured stdout, captured stderr */
+
+// Where the socket is by default, only its user may connect to it
+#define LLAMAC_DEFAULT_SOCKET_HELP "$XDG_RUNTIME_DIR/llamac.sock, or /tmp/llamac-<uid>.sock"
+
+struct CompileRequest
+{
+    std::vector<std::string> args;
+    std::string cwd;
+    std::string source;
+};
+
+struct CompileResponse
+{
+    int status;
+    std::string out, err;
+};
+
+bool sendRequest(int fd, const CompileRequest &req);
+bool recvRequest(int fd, CompileRequest &req);
+bool sendResponse(int fd, const CompileResponse &res);
+bool recvResponse(int fd, CompileResponse &res);
+std::string defaultSocketPath();
@@ -0,0 +1,257 @@
+#include "ast.hpp"
+#include "scopedtable.hpp"
+
+/*
+ * Name resolution, run once before sem.
+ *
+ * Binds every use of a symbol (ConstantCall, FunctionCall, ArrayAccess, Dim)
+ * to the LivenessEntry of the node defining it (Def, Par, For, PatternId),
+ * following the scoping rules of sem. Later phases follow that link instead
+ * of looking the name up again in tables of their own.
+ *
+ * The depth of the scope of every definition is recorded in its entry and
+ * that of every function in the function, for liveness to tell whether a
+ * symbol is defined inside a function or captured by it.
+ */
+
+ScopedTable<LivenessEntry *> RTable;
+
+void Def::setEntry(LivenessEntry *e)
+{
+    entry = e;
+}
+LivenessEntry *Def::getEntry()
+{
+    return entry;
+}
+void Par::setEntry(LivenessEntry *e)
+{
+    entry = e;
+}
+LivenessEntry *Par::getEntry()
+{
+    return entry;
+}
+
+LivenessEntry *insertDefToRTable(Def *d)
+{
+    LivenessEntry *l = new LivenessEntryDef(RTable.getCurrScope(), d);
+    d->setEntry(l);
+    RTable.insert({d->getId(), l});
+    return l;
+}
+void insertParToRTable(Par *p)
+{
+    LivenessEntry *l = new LivenessEntryPar(RTable.getCurrScope(), p);
+    p->setEntry(l);
+    RTable.insert({p->getId(), l});
+}
+
+/** @return The definition id is bound to, nullptr for library functions
+ * and imports, that are found in st */
+LivenessEntry *AST::bindToDefinition(Symbol id)
+{
+    LivenessEntry *l = RTable[id];
+    if (!l && !st.lookup(id, false))
+    {
+        printError("Identifier " + id + " not found");
+    }
+
+    return l;
+}
+
+/*******************************************************/
+
+// By default do nothing
+void AST::resolve()
+{
+    return;
+}
+
+void Program::resolve()
+{
+    for (auto *d : definition_list)
+    {
+        d->resolve();
+    }
+}
+void Letdef::resolve()
+{
+    if (recursive)
+    {
+        // Insert functions to table before all the definitions
+        std::vector<LivenessEntry *> entries;
+        for (auto *d : def_list)
+        {
+            if (d->isDef())
+            {
+                entries.push_back(insertDefToRTable(dynamic_cast<Def *>(d)));
+            }
+        }
+
+        for (auto *d : def_list)
+        {
+            d->resolve();
+        }
+        for (auto *l : entries)
+        {
+            l->visit();
+        }
+    }
+    else
+    {
+        for (auto *d : def_list)
+        {
+            d->resolve();
+        }
+
+        // Insert symbols to table after all the definitions
+        for (auto *d : def_list)
+        {
+            if (d->isDef())
+            {
+                insertDefToRTable(dynamic_cast<Def *>(d))->visit();
+            }
+        }
+    }
+}
+void Constant::resolve()
+{
+    expr->resolve();
+}
+void Function::resolve()
+{
+    // Save scope of function
+    scope = RTable.getCurrScope();
+
+    // New scope for the parameters and the body
+    RTable.openScope();
+
+    for (auto *p : par_list)
+    {
+        insertParToRTable(p);
+    }
+
+    expr->resolve();
+
+    RTable.closeScope();
+}
+void Array::resolve()
+{
+    for (auto *e : expr_list)
+    {
+        e->resolve();
+    }
+}
+
+void LetIn::resolve()
+{
+    RTable.openScope();
+
+    letdef->resolve();
+    expr->resolve();
+
+    RTable.closeScope();
+}
+void BinOp::resolve()
+{
+    lhs->resolve();
+    rhs->resolve();
+}
+void UnOp::resolve()
+{
+    expr->resolve();
+}
+void While::resolve()
+{
+    cond->resolve();
+    body->resolve();
+}
+void For::resolve()
+{
+    // The counter is only in scope of the body, as in sem
+    start->resolve();
+    finish->resolve();
+
+    RTable.openScope();
+    entry = new LivenessEntryFor(RTable.getCurrScope(), this);
+    RTable.insert({id, entry});
+
+    body->resolve();
+
+    RTable.closeScope();
+}
+void If::resolve()
+{
+    cond->resolve();
+    body->resolve();
+
+    if (else_body != nullptr)
+        else_body->resolve();
+}
+
+void Dim::resolve()
+{
+    definition = bindToDefinition(id);
+}
+void ArrayAccess::resolve()
+{
+    for (auto *e : expr_list)
+    {
+        e->resolve();
+    }
+
+    definition = bindToDefinition(id);
+}
+void ConstantCall::resolve()
+{
+    definition = bindToDefinition(id);
+}
+void ConstructorCall::resolve()
+{
+    for (auto *e : expr_list)
+    {
+        e->resolve();
+    }
+}
+void FunctionCall::resolve()
+{
+    for (auto *e : expr_list)
+    {
+        e->resolve();
+    }
+
+    definition = bindToDefinition(id);
+}
+
+void Match::resolve()
+{
+    toMatch->resolve();
+
+    for (auto *c : clause_list)
+    {
+        c->resolve();
+    }
+}
+void Clause::resolve()
+{
+    // The identifiers of the pattern are only in scope of its expression
+    RTable.openScope();
+
+    pattern->resolve();
+    expr->resolve();
+
+    RTable.closeScope();
+}
+void PatternConstr::resolve()
+{
+    for (auto *p : pattern_list)
+    {
+        p->resolve();
+    }
+}
+void PatternId::resolve()
+{
+    entry = new LivenessEntryPatternId(RTable.getCurrScope(), this);
+    RTable.insert({id, entry});
+}
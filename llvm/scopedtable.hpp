@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "intern.hpp"
+
+/** Table of nested scopes mapping names to values, shared by sem (st),
+ * liveness (LTable) and codegen (LLValues).
+ *
+ * Every name has one slot in an open addressing hash table, pointing at its
+ * innermost binding. Bindings are kept in order of insertion, each one
+ * linked to the binding of the same name it shadows, so the bindings of
+ * the innermost scope are always last: closing it pops them off while
+ * restoring the slots, in time proportional to its size. Lookups take one
+ * probe sequence whatever the nesting depth.
+ *
+ * @param T The value of a binding, T() stands for "unbound" in operator[] */
+template <class T>
+class ScopedTable
+{
+    struct Binding
+    {
+        Symbol name;
+        T value;
+        // Index of the binding of name it shadows, -1 if none
+        int32_t shadowed;
+    };
+    struct Slot
+    {
+        SymbolId name;
+        // Index of the innermost binding of name, -1 if none
+        int32_t binding;
+    };
+    static const SymbolId emptySlot = UINT32_MAX;
+
+    std::vector<Slot> slots;
+    std::size_t usedSlots = 0;
+    std::vector<Binding> bindings;
+    // Index of the first binding of every open scope
+    std::vector<std::size_t> scopeStarts;
+
+    /** @return The slot of name, or the empty slot it would take */
+    Slot &slotOf(Symbol name)
+    {
+        std::size_t mask = slots.size() - 1;
+        // Multiplying by an odd constant permutes the ids modulo the table
+        // size, so consecutive ones land apart instead of in one cluster
+        std::size_t i = (name.getId() * 2654435769u) & mask;
+        while (slots[i].name != emptySlot && slots[i].name != name.getId())
+            i = (i + 1) & mask;
+        return slots[i];
+    }
+    void grow()
+    {
+        std::vector<Slot> old = std::move(slots);
+        slots.assign(old.empty() ? 64 : old.size() * 2, Slot{emptySlot, -1});
+        for (auto &slot : old)
+        {
+            if (slot.name != emptySlot)
+                slotOf(Symbol::fromId(slot.name)) = slot;
+        }
+    }
+
+public:
+    ScopedTable(bool openGlobalScope = true)
+    {
+        grow();
+        if (openGlobalScope)
+            openScope();
+    }
+    void openScope()
+    {
+        scopeStarts.push_back(bindings.size());
+    }
+    /** Closes the innermost scope, passing the value of each of its bindings to onClose
+     * @return false if no scope was open */
+    template <class F>
+    bool closeScope(F onClose)
+    {
+        if (scopeStarts.empty())
+            return false;
+        std::size_t start = scopeStarts.back();
+        scopeStarts.pop_back();
+        while (bindings.size() > start)
+        {
+            Binding &b = bindings.back();
+            slotOf(b.name).binding = b.shadowed;
+            onClose(b.value);
+            bindings.pop_back();
+        }
+        return true;
+    }
+    bool closeScope()
+    {
+        return closeScope([](T &) {});
+    }
+    /** Binds name in the innermost scope
+     * @param overwrite Whether to replace a binding of name in the same scope
+     * @return false if name was bound in this scope already and kept */
+    bool insert(Symbol name, T value, bool overwrite = true)
+    {
+        if (2 * (usedSlots + 1) > slots.size())
+            grow();
+        Slot &slot = slotOf(name);
+        if (slot.name == emptySlot)
+        {
+            slot.name = name.getId();
+            usedSlots++;
+        }
+        if (slot.binding >= 0 && !scopeStarts.empty() && (std::size_t)slot.binding >= scopeStarts.back())
+        {
+            if (overwrite)
+                bindings[slot.binding].value = value;
+            return overwrite;
+        }
+        bindings.push_back({name, value, slot.binding});
+        slot.binding = bindings.size() - 1;
+        return true;
+    }
+    /** Can be called with the implicit pair constructor
+     * e.g.: insert({"a_name", a_pointer}) */
+    void insert(std::pair<Symbol, T> entry)
+    {
+        insert(entry.first, entry.second);
+    }
+    /** @return The value of the innermost binding of name, nullptr if unbound.
+     * Only valid until the next insertion */
+    T *find(Symbol name)
+    {
+        Slot &slot = slotOf(name);
+        if (slot.name == emptySlot || slot.binding < 0)
+            return nullptr;
+        return &bindings[slot.binding].value;
+    }
+    T operator[](Symbol name)
+    {
+        T *value = find(name);
+        return value ? *value : T();
+    }
+    int getCurrScope()
+    {
+        return scopeStarts.size() - 1;
+    }
+};
@@ -0,0 +1,134 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "intern.hpp"
+#include "scopedtable.hpp"
+
+/*
+ * Microbenchmark of ScopedTable (make bench).
+ *
+ * Times it against the scheme it replaced, a vector with a map per open
+ * scope searched from the innermost one out, on the shapes the compiler
+ * sees: deeply nested let ... in, and wide scopes (the top level of a big
+ * program) with short lived inner ones.
+ */
+
+/** The tables of sem, liveness and codegen before ScopedTable */
+template <class T>
+class MapPerScope
+{
+    std::vector<std::unordered_map<Symbol, T> *> table;
+
+public:
+    MapPerScope()
+    {
+        openScope();
+    }
+    void insert(std::pair<Symbol, T> entry)
+    {
+        (*table.back())[entry.first] = entry.second;
+    }
+    T operator[](Symbol name)
+    {
+        for (auto it = table.rbegin(); it != table.rend(); it++)
+        {
+            auto found = (*it)->find(name);
+            if (found != (*it)->end())
+                return found->second;
+        }
+        return T();
+    }
+    void openScope()
+    {
+        table.push_back(new std::unordered_map<Symbol, T>());
+    }
+    void closeScope()
+    {
+        delete table.back();
+        table.pop_back();
+    }
+};
+
+static std::vector<Symbol> makeNames(int count)
+{
+    std::vector<Symbol> names;
+    for (int i = 0; i < count; i++)
+        names.push_back(Symbol("x" + std::to_string(i)));
+    return names;
+}
+
+// let x0 = ... in let x1 = ... in ... each body using the innermost,
+// the outermost and one in the middle of the names bound so far
+template <class Table>
+static long deepNesting(const std::vector<Symbol> &names, int rounds)
+{
+    long sum = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        Table table;
+        for (std::size_t i = 0; i < names.size(); i++)
+        {
+            table.openScope();
+            table.insert({names[i], (long)i + 1});
+            sum += table[names[i]] + table[names[0]] + table[names[i / 2]];
+        }
+        for (std::size_t i = 0; i < names.size(); i++)
+            table.closeScope();
+    }
+    return sum;
+}
+
+// Every name bound in the outer scope, then many small inner scopes
+// shadowing a few of them and looking up the rest
+template <class Table>
+static long wideScopes(const std::vector<Symbol> &names, int rounds)
+{
+    long sum = 0;
+    Table table;
+    for (std::size_t i = 0; i < names.size(); i++)
+        table.insert({names[i], (long)i + 1});
+    for (int r = 0; r < rounds; r++)
+    {
+        for (std::size_t i = 0; i + 4 < names.size(); i += 4)
+        {
+            table.openScope();
+            table.insert({names[i], -1L});
+            table.insert({names[i + 1], -1L});
+            sum += table[names[i]] + table[names[i + 2]] + table[names[names.size() - 1 - i]];
+            table.closeScope();
+        }
+    }
+    return sum;
+}
+
+template <class F>
+static void report(std::string name, F run)
+{
+    auto start = std::chrono::steady_clock::now();
+    long result = run();
+    double millis = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << std::left << std::setw(32) << name
+              << std::right << std::setw(10) << std::fixed << std::setprecision(1) << millis << " ms"
+              << "  (" << result << ")" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int depth = argc > 1 ? std::atoi(argv[1]) : 2000;
+    int width = argc > 2 ? std::atoi(argv[2]) : 20000;
+    std::vector<Symbol> deepNames = makeNames(depth), wideNames = makeNames(width);
+
+    std::cout << "nesting depth " << depth << std::endl;
+    report("  ScopedTable", [&] { return deepNesting<ScopedTable<long>>(deepNames, 20); });
+    report("  map per scope", [&] { return deepNesting<MapPerScope<long>>(deepNames, 20); });
+    std::cout << "scope width " << width << std::endl;
+    report("  ScopedTable", [&] { return wideScopes<ScopedTable<long>>(wideNames, 50); });
+    report("  map per scope", [&] { return wideScopes<MapPerScope<long>>(wideNames, 50); });
+    return 0;
+}
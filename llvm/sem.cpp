@@ -15,7 +15,7 @@ void AST::sem()
 {
 }
 void AST::checkTypeGraphs(TypeGraph *t1, TypeGraph *t2,
-    std::function<void(void)> *errCallback)
+    ConstraintKind kind, const char *msg, int index)
 {
     // if (!t1->isUnknown() && !t2->isUnknown())
     // {
@@ -26,37 +26,70 @@ void AST::checkTypeGraphs(TypeGraph *t1, TypeGraph *t2,
     // }
     // else
     // {
-    inf.addConstraint(t1, t2, line_number, errCallback);
+    inf.addConstraint(t1, t2, ConstraintContext{kind, line_number, this, t1, t2, msg, index});
     // }
 }
+void AST::printConstraintError(const ConstraintContext &context)
+{
+    std::string msg = context.msg ? context.msg : "";
+    switch (context.kind)
+    {
+    case ConstraintKind::TypeCheck:
+        msg += ", " + inf.deepSubstitute(context.lhs)->stringifyTypeClean() + " given.";
+        break;
+    case ConstraintKind::SpecifiedType:
+        msg += " " + inf.deepSubstitute(context.rhs)->stringifyTypeClean() +
+               ", " + inf.deepSubstitute(context.lhs)->stringifyTypeClean() + " given.";
+        break;
+    case ConstraintKind::Parameter:
+        msg += " No. " + std::to_string(context.index) +
+               ", " + inf.deepSubstitute(context.rhs)->stringifyTypeClean() + " expected" +
+               ", " + inf.deepSubstitute(context.lhs)->stringifyTypeClean() + " given.";
+        break;
+    case ConstraintKind::Field:
+        msg += " No. " + std::to_string(context.index) +
+               ", " + inf.deepSubstitute(context.lhs)->stringifyTypeClean() + " given.";
+        break;
+    case ConstraintKind::ExpectedRef:
+        msg = "Expected ref, got " + inf.deepSubstitute(context.lhs)->stringifyTypeClean();
+        break;
+    case ConstraintKind::Dimensions:
+        msg = "Needs array of at least " + std::to_string(context.index) + " dimensions";
+        break;
+    case ConstraintKind::Message:
+    case ConstraintKind::Inferred:
+        break;
+    }
+    printError(msg, false);
+}
 
 void AST::insertToTable()
 {
 }
-void AST::insertBasicToSymbolTable(std::string id, TypeGraph *t)
+SymbolEntry *AST::insertBasicToSymbolTable(Symbol id, TypeGraph *t)
 {
-    st.insertBasic(id, t);
+    return st.insertBasic(id, t);
 }
-void AST::insertRefToSymbolTable(std::string id, TypeGraph *t)
+RefEntry *AST::insertRefToSymbolTable(Symbol id, TypeGraph *t)
 {
-    st.insertRef(id, t);
+    return st.insertRef(id, t);
 }
-void AST::insertArrayToSymbolTable(std::string id, TypeGraph *contained_type, int d)
+ArrayEntry *AST::insertArrayToSymbolTable(Symbol id, TypeGraph *contained_type, int d)
 {
-    st.insertArray(id, contained_type, d);
+    return st.insertArray(id, contained_type, d);
 }
-FunctionEntry *AST::insertFunctionToSymbolTable(std::string id, TypeGraph *t)
+FunctionEntry *AST::insertFunctionToSymbolTable(Symbol id, TypeGraph *t)
 {
     return st.insertFunction(id, t);
 }
-void AST::insertTypeToTypeTable(std::string id)
+void AST::insertTypeToTypeTable(Symbol id)
 {
     if (!tt.insertType(id))
     {
         printError("Type " + id + " has already been defined");
     }
 }
-ConstructorEntry *AST::insertConstructorToConstructorTable(std::string Id)
+ConstructorEntry *AST::insertConstructorToConstructorTable(Symbol Id)
 {
     ConstructorEntry *c = ct.insertConstructor(Id);
     if (!c)
@@ -67,7 +100,7 @@ ConstructorEntry *AST::insertConstructorToConstructorTable(std::string Id)
 
     return c;
 }
-SymbolEntry *AST::lookupBasicFromSymbolTable(std::string id)
+SymbolEntry *AST::lookupBasicFromSymbolTable(Symbol id)
 {
     SymbolEntry *s = st.lookup(id, false);
     if (!s)
@@ -77,7 +110,7 @@ SymbolEntry *AST::lookupBasicFromSymbolTable(std::string id)
 
     return s;
 }
-ArrayEntry *AST::lookupArrayFromSymbolTable(std::string id)
+ArrayEntry *AST::lookupArrayFromSymbolTable(Symbol id)
 {
     ArrayEntry *s = st.lookupArray(id, false);
     if (!s)
@@ -87,7 +120,7 @@ ArrayEntry *AST::lookupArrayFromSymbolTable(std::string id)
 
     return s;
 }
-TypeEntry *AST::lookupTypeFromTypeTable(std::string id)
+TypeEntry *AST::lookupTypeFromTypeTable(Symbol id)
 {
     TypeEntry *t = tt.lookupType(id, false);
     if (!t)
@@ -97,7 +130,7 @@ TypeEntry *AST::lookupTypeFromTypeTable(std::string id)
 
     return t;
 }
-ConstructorEntry *AST::lookupConstructorFromContstructorTable(std::string Id)
+ConstructorEntry *AST::lookupConstructorFromContstructorTable(Symbol Id)
 {
     ConstructorEntry *c = ct.lookupConstructor(Id, false);
     if (!c)
@@ -107,6 +140,15 @@ ConstructorEntry *AST::lookupConstructorFromContstructorTable(std::string Id)
 
     return c;
 }
+TypeGraph *AST::lookupDefinitionTypeGraph(LivenessEntry *definition, Symbol id)
+{
+    if (!definition)
+    {
+        return lookupBasicFromSymbolTable(id)->getTypeGraph();
+    }
+
+    return definition->getSymbolTypeGraph();
+}
 
 /*********************************/
 /**          Type                */
@@ -142,6 +184,8 @@ TypeGraph *BasicType::get_TypeGraph()
 }
 TypeGraph *UnknownType::get_TypeGraph()
 {
+    if (!TG)
+        TG = new UnknownTypeGraph(true, true, false);
     return TG;
 }
 TypeGraph *FunctionType::get_TypeGraph()
@@ -152,19 +196,16 @@ TypeGraph *FunctionType::get_TypeGraph()
         TypeGraph *r = rhtype->get_TypeGraph();
 
         // No type inference needed here because FunctionType is called only if the type is given
+        // Operator -> is right associative
+        // so l is the first parameter, followed by those of r
+        std::vector<TypeGraph *> params = {l};
+        TypeGraph *result = r;
         if (r->isFunction())
         {
-            TG = r;
+            params.insert(params.end(), r->getParamTypes().begin(), r->getParamTypes().end());
+            result = r->getResultType();
         }
-        else
-        {
-            TG = new FunctionTypeGraph(r);
-        }
-
-        // Operator -> is right associative
-        // so the parameters will be added
-        // from last to first
-        TG->addParam(l, false);
+        TG = typeContext().getFunction(params, result);
     }
 
     return TG;
@@ -172,13 +213,13 @@ TypeGraph *FunctionType::get_TypeGraph()
 TypeGraph *ArrayType::get_TypeGraph()
 {
     if (!TG)
-        TG = new ArrayTypeGraph(dimensions, new RefTypeGraph(elem_type->get_TypeGraph()));
+        TG = typeContext().getArray(dimensions, typeContext().getRef(elem_type->get_TypeGraph()));
     return TG;
 }
 TypeGraph *RefType::get_TypeGraph()
 {
     if (!TG)
-        TG = new RefTypeGraph(ref_type->get_TypeGraph());
+        TG = typeContext().getRef(ref_type->get_TypeGraph());
 
     return TG;
 }
@@ -208,12 +249,12 @@ TypeGraph *Par::get_TypeGraph()
 {
     return T->get_TypeGraph();
 }
-std::string Par::getId()
+Symbol Par::getId()
 {
     return id;
 }
 
-std::string DefStmt::getId()
+Symbol DefStmt::getId()
 {
     return id;
 }
@@ -247,6 +288,7 @@ void Constant::insertToTable()
     TG = T->get_TypeGraph();
     
     insertBasicToSymbolTable(id, TG);
+    entry->setSymbolTypeGraph(TG);
     addToIdList(id);
 }
 void Function::insertToTable()
@@ -262,10 +304,12 @@ void Function::insertToTable()
     addToIdList(id);
 
     TG = F->getTypeGraph();
+    entry->setSymbolTypeGraph(TG);
 }
 void Par::insertToTable()
 {
     insertBasicToSymbolTable(id, T->get_TypeGraph());
+    entry->setSymbolTypeGraph(T->get_TypeGraph());
 
     addToIdList(id);
 }
@@ -273,7 +317,8 @@ void Array::insertToTable()
 {
     int d = get_dimensions();
     TypeGraph *t = T->get_TypeGraph();
-    RefTypeGraph *contained_type = new RefTypeGraph(t);
+    TypeGraph *contained_type = typeContext().getRef(t);
+    ArrayEntry *a;
 
     if (!t->isUnknown())
     {
@@ -281,33 +326,37 @@ void Array::insertToTable()
         {
             printError("Array cannot contain arrays");
         }
-        insertArrayToSymbolTable(id, contained_type, d);
+        a = insertArrayToSymbolTable(id, contained_type, d);
     }
     else
     {
         TypeGraph *unknown_contained_type = new UnknownTypeGraph(false, true, false);
-        insertArrayToSymbolTable(id, unknown_contained_type, d);
+        a = insertArrayToSymbolTable(id, unknown_contained_type, d);
         inf.addConstraint(unknown_contained_type, contained_type, line_number);
     }
+    entry->setSymbolTypeGraph(a->getTypeGraph());
     addToIdList(id);
     
-    TG = new ArrayTypeGraph(d, contained_type);
+    TG = typeContext().getArray(d, contained_type);
 }
 void Variable::insertToTable()
 {
     TypeGraph *t = T->get_TypeGraph();
-    TypeGraph *ref_type = new RefTypeGraph(t);
+    TypeGraph *ref_type = typeContext().getRef(t);
+
+    SymbolEntry *s;
 
     if (!t->isUnknown())
     {
-        insertRefToSymbolTable(id, t);
+        s = insertRefToSymbolTable(id, t);
     }
     else
     {
         TypeGraph *unknown_ref_type = new UnknownTypeGraph(false, true, false);
-        insertBasicToSymbolTable(id, unknown_ref_type);
+        s = insertBasicToSymbolTable(id, unknown_ref_type);
         inf.addConstraint(unknown_ref_type, ref_type, line_number);
     }
+    entry->setSymbolTypeGraph(s->getTypeGraph());
 
     addToIdList(id);
     
@@ -333,9 +382,8 @@ void Tdef::sem()
 }
 void Constant::sem()
 {
-    std::string err = "Must be of specified type " + T->get_TypeGraph()->stringifyType();
     expr->sem();
-    expr->type_check(T->get_TypeGraph(), err);
+    expr->type_check(T->get_TypeGraph(), "Must be of specified type", ConstraintKind::SpecifiedType);
 }
 void Function::sem()
 {
@@ -349,9 +397,8 @@ void Function::sem()
     }
 
     // Check the type of the expression (and call sem)
-    std::string err = "Function body must be of specified type " + T->get_TypeGraph()->stringifyType();
     expr->sem();
-    expr->type_check(T->get_TypeGraph(), err);
+    expr->type_check(T->get_TypeGraph(), "Function body must be of specified type", ConstraintKind::SpecifiedType);
 
     // Close the scope
     st.closeScope();
@@ -451,16 +498,9 @@ TypeGraph *Expr::get_TypeGraph()
 {
     return TG;
 }
-void Expr::type_check(TypeGraph *t, std::string msg)
+void Expr::type_check(TypeGraph *t, const char *msg, ConstraintKind kind, int index)
 {
-    checkTypeGraphs(TG, t, new std::function<void(void)>(
-        [=]() {
-            printError(
-                msg + ", " + inf.deepSubstitute(TG)->stringifyTypeClean() + " given.",
-                false
-            );
-        }
-    ));
+    checkTypeGraphs(TG, t, kind, msg, index);
 }
 void Expr::checkIntCharFloat(std::string msg)
 {
@@ -476,7 +516,7 @@ void Expr::checkIntCharFloat(std::string msg)
         TG->setIntCharFloat();
     }
 }
-void same_type(Expr *e1, Expr *e2, std::string msg = "Type mismatch")
+void same_type(Expr *e1, Expr *e2, const char *msg = "Type mismatch")
 {
     e1->type_check(e2->TG, msg);
 }
@@ -514,7 +554,7 @@ int Int_literal::get_int()
 
 void String_literal::sem()
 {
-    TG = new ArrayTypeGraph(1, new RefTypeGraph(type_char));
+    TG = typeContext().getArray(1, typeContext().getRef(type_char));
 }
 void Char_literal::sem()
 {
@@ -573,14 +613,7 @@ void UnOp::sem()
         // to ensure that expr is in fact a ref
         TypeGraph *unknown = new UnknownTypeGraph(false, true, false);
         TypeGraph *ref_t = new RefTypeGraph(unknown);
-        inf.addConstraint(t_expr, ref_t, line_number, new std::function<void(void)>(
-            [=]() {
-                printError(
-                    std::string("Expected ref, got ") + inf.deepSubstitute(t_expr)->stringifyTypeClean(),
-                    false
-                );
-            }
-        ));
+        checkTypeGraphs(t_expr, ref_t, ConstraintKind::ExpectedRef);
 
         TG = ref_t->getContainedType();
         break;
@@ -591,14 +624,7 @@ void UnOp::sem()
         // to ensure that expr is in fact a ref
         TypeGraph *unknown_t = new UnknownTypeGraph(false, true, false);
         TypeGraph *ref_t = new RefTypeGraph(unknown_t);
-        inf.addConstraint(t_expr, ref_t, line_number, new std::function<void(void)>(
-            [=]() {
-                printError(
-                    std::string("Expected ref, got ") + inf.deepSubstitute(t_expr)->stringifyTypeClean(),
-                    false
-                );
-            }
-        ));
+        checkTypeGraphs(t_expr, ref_t, ConstraintKind::ExpectedRef);
 
         TG = type_unit;
         break;
@@ -688,8 +714,8 @@ void BinOp::sem()
     case T_coloneq:
     {
         // The lhs must be a ref of the same type as the rhs
-        RefTypeGraph *correct_lhs = new RefTypeGraph(t_rhs);
-        lhs->type_check(correct_lhs, "Must be a ref of " + t_rhs->stringifyType());
+        TypeGraph *correct_lhs = typeContext().getRef(t_rhs);
+        lhs->type_check(correct_lhs, "Must be", ConstraintKind::SpecifiedType);
 
         // Cleanup NOTE: If the new TypeGraph is
         // used for inference it should not be deleted
@@ -717,7 +743,7 @@ void New::sem()
         printError("Array type cannot be allocated with new");
     }
 
-    TG = new RefTypeGraph(t);
+    TG = typeContext().getRef(t);
 }
 
 void While::sem()
@@ -730,20 +756,22 @@ void While::sem()
 
     TG = type_unit;
 }
-std::string For::getId()
+Symbol For::getId()
 {
     return id;
 }
 void For::sem()
 {
+    // Start and finish are outside the scope of the counter
+    start->sem();
+    finish->sem();
+
     // Create new scope for counter and add it
     st.openScope();
     insertBasicToSymbolTable(id, type_int);
+    entry->setSymbolTypeGraph(type_int);
     addToIdList(id);
 
-    // Typecheck start, finish, body
-    start->sem();
-    finish->sem();
     body->sem();
 
     start->type_check(type_int, "Start value of iterator must be int");
@@ -781,8 +809,8 @@ void If::sem()
 
 void Dim::sem()
 {
-    // Lookup the array
-    SymbolEntry *arr = lookupBasicFromSymbolTable(id);
+    // The type of the array
+    TypeGraph *arr = lookupDefinitionTypeGraph(definition, id);
 
     // Get the number of the dimension
     int i = dim->get_int();
@@ -795,25 +823,17 @@ void Dim::sem()
 
     ArrayTypeGraph *constraintArray =
         new ArrayTypeGraph(-1, new UnknownTypeGraph(), i);
-    inf.addConstraint(arr->getTypeGraph(), constraintArray, line_number, new std::function<void(void)>(
-        [=]() {
-            printError(
-                std::string("Needs array of at least ") + std::to_string(i) + " dimensions",
-                false
-            );
-        }
-    ));
+    checkTypeGraphs(arr, constraintArray, ConstraintKind::Dimensions, nullptr, i);
     TG = type_int;
 }
 
 void ConstantCall::sem()
 {
-    SymbolEntry *s = lookupBasicFromSymbolTable(id);
-    TG = s->getTypeGraph();
+    TG = lookupDefinitionTypeGraph(definition, id);
 }
 void FunctionCall::sem()
 {
-    TypeGraph *definitionTypeGraph = lookupBasicFromSymbolTable(id)->getTypeGraph();
+    TypeGraph *definitionTypeGraph = lookupDefinitionTypeGraph(definition, id);
     int count;
     if (definitionTypeGraph->isUnknown())
     {
@@ -846,14 +866,13 @@ void FunctionCall::sem()
             printError("Too many arguments given to function");
         }
 
-        std::string err = "Type mismatch on parameter No. ";
         TypeGraph *correct_t;
         for (int i = 0; i < count; i++)
         {
             correct_t = definitionTypeGraph->getParamType(i);
 
             expr_list[i]->sem();
-            expr_list[i]->type_check(correct_t, err + std::to_string(i + 1) + ", " + correct_t->stringifyTypeClean() + " expected");
+            expr_list[i]->type_check(correct_t, "Type mismatch on parameter", ConstraintKind::Parameter, i + 1);
         }
 
         TG = definitionTypeGraph->getResultType();
@@ -874,14 +893,13 @@ void ConstructorCall::sem()
         printError("Partial constructor call not allowed");
     }
 
-    std::string err = "Type mismatch on field No. ";
     TypeGraph *correct_t;
     for (int i = 0; i < count; i++)
     {
         correct_t = constructorTypeGraph->getFieldType(i);
 
         expr_list[i]->sem();
-        expr_list[i]->type_check(correct_t, err + std::to_string(i + 1));
+        expr_list[i]->type_check(correct_t, "Type mismatch on field", ConstraintKind::Field, i + 1);
     }
 
     TG = c->getTypeGraph()->getCustomType();
@@ -889,8 +907,7 @@ void ConstructorCall::sem()
 void ArrayAccess::sem()
 {
     int args_n = (int)expr_list.size();
-    SymbolEntry *a = lookupBasicFromSymbolTable(id);
-    TypeGraph *t = a->getTypeGraph();
+    TypeGraph *t = lookupDefinitionTypeGraph(definition, id);
 
     // If it is known check that the dimensions are correct
     // and the indices provided are integers
@@ -940,13 +957,10 @@ void Pattern::checkPatternTypeGraph(TypeGraph *t)
 void PatternLiteral::checkPatternTypeGraph(TypeGraph *t)
 {
     literal->sem();
-    checkTypeGraphs(t, literal->get_TypeGraph(), new std::function<void(void)>(
-        [=]() {
-            printError("Literal is not a valid pattern for given type", false);
-        }
-    ));
+    checkTypeGraphs(t, literal->get_TypeGraph(), ConstraintKind::Message,
+                    "Literal is not a valid pattern for given type");
 }
-std::string PatternId::getId()
+Symbol PatternId::getId()
 {
     return id;
 }
@@ -958,6 +972,7 @@ void PatternId::checkPatternTypeGraph(TypeGraph *t)
 {
     // Insert a new symbol with name id and type the same as that of e
     insertBasicToSymbolTable(id, t);
+    entry->setSymbolTypeGraph(t);
     
     addToIdList(id);
 
@@ -969,11 +984,8 @@ void PatternConstr::checkPatternTypeGraph(TypeGraph *t)
     constrTypeGraph = dynamic_cast<ConstructorTypeGraph *>(c->getTypeGraph());
 
     // Check that toMatch is of the same type as constructor or force it to be
-    checkTypeGraphs(t, constrTypeGraph->getCustomType(), new std::function<void(void)>(
-        [=]() {
-            printError("Constructor is not of the same type as the expression to match", false);
-        }
-    ));
+    checkTypeGraphs(t, constrTypeGraph->getCustomType(), ConstraintKind::Message,
+                    "Constructor is not of the same type as the expression to match");
 
     int count = constrTypeGraph->getFieldCount();
     if (count != (int)pattern_list.size())
@@ -1021,11 +1033,8 @@ void Match::sem()
             curr = c->get_exprTypeGraph();
 
             // Check that they are of the same type or force them to be
-            checkTypeGraphs(prev, curr, new std::function<void(void)>(
-                [=]() {
-                    printError("Results of match have different types", false);
-                }
-            ));
+            checkTypeGraphs(prev, curr, ConstraintKind::Message,
+                            "Results of match have different types");
 
             // Move prev
             prev = curr;
@@ -0,0 +1,151 @@
+#include <iostream>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "ast.hpp"
+#include "protocol.hpp"
+#include "server.hpp"
+#include "source.hpp"
+
+static std::string readCaptured(int fd)
+{
+    std::string captured;
+    char buf[4096];
+    ssize_t n;
+    lseek(fd, 0, SEEK_SET);
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        captured.append(buf, n);
+    return captured;
+}
+
+static void handleConnection(int conn, int (*compileRequest)(int argc, char **argv))
+{
+    CompileRequest req;
+    if (!recvRequest(conn, req) || req.args.empty())
+        exit(1);
+
+    int outFd = memfd_create("llamac-stdout", 0),
+        errFd = memfd_create("llamac-stderr", 0);
+    if (outFd == -1 || errFd == -1)
+        exit(1);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(conn);
+        dup2(outFd, STDOUT_FILENO);
+        dup2(errFd, STDERR_FILENO);
+        if (!req.cwd.empty() && chdir(req.cwd.c_str()))
+        {
+            std::cerr << "Couldn't change directory to " << req.cwd << std::endl;
+            exit(1);
+        }
+
+        // A source buffer is compiled in place of stdin (input file "-")
+        inputSource.setString(std::move(req.source));
+
+        std::vector<char *> argv;
+        for (auto &arg : req.args)
+            argv.push_back(&arg[0]);
+        argv.push_back(nullptr);
+
+        int result = compileRequest(argv.size() - 1, argv.data());
+        llvm::outs().flush();
+        std::fflush(nullptr);
+        exit(result);
+    }
+
+    CompileResponse res;
+    int status;
+    if (pid == -1 || waitpid(pid, &status, 0) == -1)
+        res.status = 1;
+    else
+        res.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    res.out = readCaptured(outFd);
+    res.err = readCaptured(errFd);
+    sendResponse(conn, res);
+}
+
+int runServer(std::string socketPath, int (*compileRequest)(int argc, char **argv))
+{
+    AST::prepareCompilation("module.ll");
+
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "Socket path " << socketPath << " is too long" << std::endl;
+        return 1;
+    }
+    std::strcpy(addr.sun_path, socketPath.c_str());
+
+    // Only the socket of an earlier server is replaced
+    struct stat st;
+    if (lstat(socketPath.c_str(), &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            std::cerr << socketPath << " exists and is not a socket" << std::endl;
+            return 1;
+        }
+        unlink(socketPath.c_str());
+    }
+
+    // Created accessible to its user only
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t previousMask = umask(0177);
+    bool bound = sock != -1 && bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(previousMask);
+    if (!bound || listen(sock, SOMAXCONN) == -1)
+    {
+        std::cerr << "Couldn't listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    // Connection handlers are never waited for
+    std::signal(SIGCHLD, SIG_IGN);
+    std::cerr << "llamac: serving on " << socketPath << std::endl;
+    while (true)
+    {
+        int conn = accept(sock, nullptr, nullptr);
+        if (conn == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "Couldn't accept connection: " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        // Requests compile and write files as the server's user, so no one else may make them
+        struct ucred peer;
+        socklen_t peerSize = sizeof(peer);
+        if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &peer, &peerSize) == -1 || peer.uid != getuid())
+        {
+            close(conn);
+            continue;
+        }
+
+        std::cout.flush();
+        std::cerr.flush();
+        std::fflush(nullptr);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(sock);
+            std::signal(SIGCHLD, SIG_DFL);
+            handleConnection(conn, compileRequest);
+            exit(0);
+        }
+        close(conn);
+    }
+}
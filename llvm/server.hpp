@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+/** Runs the compile server on a Unix socket. The target and the runtime
+ * declarations are set up once, then every request is compiled by
+ * compileRequest in a process forked from the warm server
+ * @param compileRequest Parses the request's arguments and compiles, returns exit code */
+int runServer(std::string socketPath, int (*compileRequest)(int argc, char **argv));
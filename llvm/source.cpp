@@ -0,0 +1,117 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.hpp"
+
+SourceBuffer inputSource;
+
+// flex needs two NUL bytes after the text it scans in place
+static const std::size_t scanPadding = 2;
+
+SourceBuffer::~SourceBuffer()
+{
+    release();
+}
+void SourceBuffer::release()
+{
+    if (mapped)
+        munmap(base, mapped);
+    mapped = 0;
+    owned.clear();
+    base = nullptr;
+    size = 0;
+    loaded = false;
+}
+
+bool SourceBuffer::mapFile(std::string filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+    {
+        // Pipes and devices can only be read
+        bool read = readFd(fd);
+        close(fd);
+        return read;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        setString("");
+        return true;
+    }
+
+    // Anonymous zero pages are reserved for the padding and the file is
+    // mapped over them. The tail of its last page reads as zeros too, so
+    // the padding is there whether or not it crosses into a page of its own
+    std::size_t length = st.st_size + scanPadding;
+    void *area = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+    if (mmap(area, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(area, length);
+        close(fd);
+        return false;
+    }
+    close(fd);
+    madvise(area, st.st_size, MADV_SEQUENTIAL);
+
+    release();
+    base = (char *)area;
+    size = st.st_size;
+    mapped = length;
+    loaded = true;
+    return true;
+}
+
+bool SourceBuffer::readFd(int fd)
+{
+    std::string source;
+    char chunk[65536];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) != 0)
+    {
+        if (n < 0)
+            return false;
+        source.append(chunk, n);
+    }
+    setString(std::move(source));
+    return true;
+}
+
+void SourceBuffer::setString(std::string source)
+{
+    release();
+    owned = std::move(source);
+    size = owned.size();
+    owned.append(scanPadding, '\0');
+    base = &owned[0];
+    loaded = true;
+}
+
+bool SourceBuffer::isLoaded()
+{
+    return loaded;
+}
+
+char *SourceBuffer::scanBase()
+{
+    return base;
+}
+std::size_t SourceBuffer::scanSize()
+{
+    return size + scanPadding;
+}
+
+llvm::StringRef SourceBuffer::text()
+{
+    return llvm::StringRef(base, size);
+}
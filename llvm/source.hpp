@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <llvm/ADT/StringRef.h>
+
+/** The source text being compiled, held in memory the way flex scans a
+ * buffer in place (yy_scan_buffer): writable and followed by two NUL bytes.
+ * Files are memory mapped rather than read through stdio */
+class SourceBuffer
+{
+    char *base = nullptr;
+    std::size_t size = 0;
+    // Length of the mapping when base is mapped, 0 otherwise
+    std::size_t mapped = 0;
+    // Backs base when the source was given in memory or read from a pipe
+    std::string owned;
+    bool loaded = false;
+
+    void release();
+
+public:
+    ~SourceBuffer();
+    /** Maps the file privately, so that the scanner may write to its pages
+     * @return false if it can't be opened or mapped */
+    bool mapFile(std::string filename);
+    /** Reads the whole of a descriptor that can't be mapped, e.g. stdin */
+    bool readFd(int fd);
+    /** Takes a source held in memory, e.g. sent to the compile server */
+    void setString(std::string source);
+    bool isLoaded();
+    /** The buffer to scan (see ParseContext), padding included */
+    char *scanBase();
+    std::size_t scanSize();
+    llvm::StringRef text();
+};
+
+extern SourceBuffer inputSource;
@@ -1,6 +1,6 @@
 #include <iostream>
 #include <vector>
-#include <map>
+#include <unordered_map>
 #include <string>
 #include <algorithm>
 #include "symbol.hpp"
@@ -8,8 +8,7 @@
 /*************************************************************/
 /**                   Common aliases                         */
 /*************************************************************/
-using tScope = std::map<std::string, SymbolEntry *>;
-using sTable = std::vector<tScope *>;
+using tScope = std::unordered_map<Symbol, SymbolEntry *>;
 using std::string;
 
 /*************************************************************/
@@ -17,25 +16,21 @@ using std::string;
 /*************************************************************/
 
 /** Helper function checking existsence of an identifier in a scope */
-bool nameInScope(string name, tScope *scope) {
+bool nameInScope(Symbol name, tScope *scope) {
     return (scope->find(name) != scope->end());
 }
 /*************************************************************/
 /**           SymbolTable method implementations             */
 /*************************************************************/
 
-SymbolTable::SymbolTable(bool debug, bool openGlobalScope) {
+SymbolTable::SymbolTable(bool debug, bool openGlobalScope)
+: Table(openGlobalScope) {
     this->debug = debug;
-    Table = new sTable();
-    if (openGlobalScope) {
-        openScope();
-    }
     insertLibFunctions();
 }
 SymbolTable::~SymbolTable() {
     while(closeScope())
         ; // do nothing while deleting scopes
-    delete Table; // delete the Table at the end
 }
 //! Deprecated 
 void SymbolTable::error(string msg, bool crash) {
@@ -53,7 +48,8 @@ void SymbolTable::insertLibFunctions() {
         tt.lookupType("float")->getTypeGraph() // 4
         // 5th will be array of char (string)
     };
-    TypeGraph *stringType = new ArrayTypeGraph(1, new RefTypeGraph(basicTypes[3]));
+    TypeContext &types = typeContext();
+    TypeGraph *stringType = types.getArray(1, types.getRef(basicTypes[3]));
     string stringTypeName = "string";
     std::vector<string> names;
     std::transform(basicTypes.begin(), basicTypes.end(),
@@ -77,39 +73,24 @@ void SymbolTable::insertLibFunctions() {
                 paramType = basicTypes[0];
             }
             if (!j && i == 5) { // read_string is special
-                funcType = new FunctionTypeGraph(basicTypes[0]);
-                funcType->addParam(basicTypes[5]);
+                funcType = types.getFunction({basicTypes[5]}, basicTypes[0]);
             } else {
-                funcType = new FunctionTypeGraph(resType);
-                funcType->addParam(paramType);
+                funcType = types.getFunction({paramType}, resType);
             }
             insertBasic(prefix + names[i], funcType);
         }
     }
-    TypeGraph *int_to_int = new FunctionTypeGraph(basicTypes[1]),
-              *float_to_float = new FunctionTypeGraph(basicTypes[4]),
-              *unit_to_float = new FunctionTypeGraph(basicTypes[4]),
-              *int_to_float = new FunctionTypeGraph(basicTypes[4]),
-              *float_to_int = new FunctionTypeGraph(basicTypes[1]),
-              *char_to_int = new FunctionTypeGraph(basicTypes[1]),
-              *int_to_char = new FunctionTypeGraph(basicTypes[3]),
-              *int_ref_to_unit = new FunctionTypeGraph(basicTypes[0]),
-              *arrchar_to_int = new FunctionTypeGraph(basicTypes[1]),
-              *arrchar_arrchar_to_int = new FunctionTypeGraph(basicTypes[1]),
-              *arrchar_arrchar_to_unit = new FunctionTypeGraph(basicTypes[0]);
-    int_to_int->addParam(basicTypes[1]);
-    float_to_float->addParam(basicTypes[4]);
-    unit_to_float->addParam(basicTypes[0]);
-    int_to_float->addParam(basicTypes[1]);
-    float_to_int->addParam(basicTypes[4]);
-    char_to_int->addParam(basicTypes[3]);
-    int_to_char->addParam(basicTypes[1]);
-    int_ref_to_unit->addParam(new RefTypeGraph(basicTypes[1]));
-    arrchar_to_int->addParam(basicTypes[5]);
-    arrchar_arrchar_to_int->addParam(basicTypes[5]);
-    arrchar_arrchar_to_int->addParam(basicTypes[5]);
-    arrchar_arrchar_to_unit->addParam(basicTypes[5]);
-    arrchar_arrchar_to_unit->addParam(basicTypes[5]);
+    TypeGraph *int_to_int = types.getFunction({basicTypes[1]}, basicTypes[1]),
+              *float_to_float = types.getFunction({basicTypes[4]}, basicTypes[4]),
+              *unit_to_float = types.getFunction({basicTypes[0]}, basicTypes[4]),
+              *int_to_float = types.getFunction({basicTypes[1]}, basicTypes[4]),
+              *float_to_int = types.getFunction({basicTypes[4]}, basicTypes[1]),
+              *char_to_int = types.getFunction({basicTypes[3]}, basicTypes[1]),
+              *int_to_char = types.getFunction({basicTypes[1]}, basicTypes[3]),
+              *int_ref_to_unit = types.getFunction({types.getRef(basicTypes[1])}, basicTypes[0]),
+              *arrchar_to_int = types.getFunction({basicTypes[5]}, basicTypes[1]),
+              *arrchar_arrchar_to_int = types.getFunction({basicTypes[5], basicTypes[5]}, basicTypes[1]),
+              *arrchar_arrchar_to_unit = types.getFunction({basicTypes[5], basicTypes[5]}, basicTypes[0]);
     insertBasic("abs", int_to_int);
     insertBasic("fabs", float_to_float);
     insertBasic("sqrt", float_to_float);
@@ -138,21 +119,16 @@ void SymbolTable::enable_logs() { debug = true; }
 SymbolEntry* SymbolTable::insert(SymbolEntry *entry, bool overwrite) {
     if (debug) 
         log("Inserting " + entry->getTypeGraph()->stringifyType() + " with name " + entry->name);
-    if (nameInScope(entry->name, Table->back()) && !overwrite) {
-            return nullptr;
-    } else {
-        // creates or updates existing
-        (*Table->back())[entry->name] = entry;
-        return entry;
-    }
+    // creates or updates existing
+    if (!Table.insert(entry->name, entry, overwrite))
+        return nullptr;
+    return entry;
 }
-SymbolEntry* SymbolTable::lookup(string name, bool err) {
+SymbolEntry* SymbolTable::lookup(Symbol name, bool err) {
     if (debug)
         log("Looking up name: " + name);
-    for (auto it = Table->rbegin(); it != Table->rend(); ++it) {
-        if (nameInScope(name, *it)) {
-            return (**it)[name];
-        }
+    if (SymbolEntry **found = Table.find(name)) {
+        return *found;
     }
     if (debug)
         log("Symbol " + name + " not found");
@@ -162,46 +138,38 @@ SymbolEntry* SymbolTable::lookup(string name, bool err) {
 void SymbolTable::openScope() {
     if (debug)
         log("Opening a new scope");
-    Table->push_back(new tScope());
+    Table.openScope();
 }
 bool SymbolTable::closeScope(bool deleteEntries) {
     if (debug)
         log("Closing a scope");
-    if (Table->size() != 0) {
-        tScope *poppedScope = Table->back();
-        Table->pop_back();
-        if (deleteEntries) {
-            for (auto &pair: *poppedScope) {
-                delete pair.second;
-            }
-        }
-        delete poppedScope;
-        return true;
-    }
-    return false;
+    return Table.closeScope([=](SymbolEntry *entry) {
+        if (deleteEntries)
+            delete entry;
+    });
 }
 
 /******************************************/
 /** Insert wrapper method implementations */
 /******************************************/
 
-SymbolEntry* SymbolTable::insertBasic(string name, TypeGraph *t, bool overwrite) {
+SymbolEntry* SymbolTable::insertBasic(Symbol name, TypeGraph *t, bool overwrite) {
     SymbolEntry* basicEntry = new SymbolEntry(name, t);
     return insert(basicEntry, overwrite);
 }
-FunctionEntry* SymbolTable::insertFunction(string name, TypeGraph *resT, bool overwrite) {
+FunctionEntry* SymbolTable::insertFunction(Symbol name, TypeGraph *resT, bool overwrite) {
     FunctionTypeGraph* funcType = new FunctionTypeGraph(resT);
     FunctionEntry* funcEntry = new FunctionEntry(name, funcType);
     return dynamic_cast<FunctionEntry *>(insert(funcEntry, overwrite));
 }
-ArrayEntry* SymbolTable::insertArray(string name, TypeGraph *containedT, int dimensions,
+ArrayEntry* SymbolTable::insertArray(Symbol name, TypeGraph *containedT, int dimensions,
                                       bool overwrite) {
-    ArrayTypeGraph* arrType = new ArrayTypeGraph(dimensions, containedT);
+    TypeGraph* arrType = typeContext().getArray(dimensions, containedT);
     ArrayEntry* arrEntry = new ArrayEntry(name, arrType);
     return dynamic_cast<ArrayEntry *>(insert(arrEntry, overwrite));
 }
-RefEntry* SymbolTable::insertRef(string name, TypeGraph *pointedT, bool overwrite) {
-    RefTypeGraph* refType = new RefTypeGraph(pointedT);
+RefEntry* SymbolTable::insertRef(Symbol name, TypeGraph *pointedT, bool overwrite) {
+    TypeGraph* refType = typeContext().getRef(pointedT);
     RefEntry* refEntry = new RefEntry(name,refType);
     return dynamic_cast<RefEntry *>(insert(refEntry, overwrite));
 }
@@ -210,7 +178,7 @@ RefEntry* SymbolTable::insertRef(string name, TypeGraph *pointedT, bool overwrit
 /** Lookup wrapper method implementations */
 /******************************************/
 
-FunctionEntry* SymbolTable::lookupFunction(string name, bool err) {
+FunctionEntry* SymbolTable::lookupFunction(Symbol name, bool err) {
     if (SymbolEntry* candidate = lookup(name, err)) {
         if (candidate->getTypeGraph()->isFunction()) 
             return dynamic_cast<FunctionEntry *>(candidate);
@@ -219,7 +187,7 @@ FunctionEntry* SymbolTable::lookupFunction(string name, bool err) {
         log("Function " + name + " not found");
     return nullptr;
 }
-ArrayEntry* SymbolTable::lookupArray(string name, bool err) {
+ArrayEntry* SymbolTable::lookupArray(Symbol name, bool err) {
     if (SymbolEntry* candidate = lookup(name, err)) {
         if (candidate->getTypeGraph()->isArray()) 
             return dynamic_cast<ArrayEntry *>(candidate);
@@ -228,7 +196,7 @@ ArrayEntry* SymbolTable::lookupArray(string name, bool err) {
         log("Array " + name + " not found");
     return nullptr;
 }
-RefEntry* SymbolTable::lookupRef(string name, bool err) {
+RefEntry* SymbolTable::lookupRef(Symbol name, bool err) {
     if (SymbolEntry* candidate = lookup(name, err)) {
         if (candidate->getTypeGraph()->isRef())
             return dynamic_cast<RefEntry *>(candidate);
@@ -273,11 +241,12 @@ SymbolEntry* BaseTable::insert(SymbolEntry *entry, bool overwrite) {
         return entry;
     }
 }
-SymbolEntry* BaseTable::lookup(string name, bool err) {
+SymbolEntry* BaseTable::lookup(Symbol name, bool err) {
     if (debug)
         log("Looking up name: " + name);
-    if (nameInScope(name, Table)) {
-        return (*Table)[name];
+    auto found = Table->find(name);
+    if (found != Table->end()) {
+        return found->second;
     }
     if (debug)
         log("Name " + name + " not found");
@@ -289,18 +258,19 @@ SymbolEntry* BaseTable::lookup(string name, bool err) {
 /*************************************************************/
 
 TypeTable::TypeTable(bool debug): BaseTable("\033[1m\033[31mTypeTable\033[0m", debug) {
-    insert(new TypeEntry("int",  new IntTypeGraph()));
-    insert(new TypeEntry("float", new FloatTypeGraph()));
-    insert(new TypeEntry("char", new CharTypeGraph()));
-    insert(new TypeEntry("unit" , new UnitTypeGraph()));
-    insert(new TypeEntry("bool" , new BoolTypeGraph()));
+    TypeContext &types = typeContext();
+    insert(new TypeEntry("int",  types.getBasic(graphType::TYPE_int)));
+    insert(new TypeEntry("float", types.getBasic(graphType::TYPE_float)));
+    insert(new TypeEntry("char", types.getBasic(graphType::TYPE_char)));
+    insert(new TypeEntry("unit" , types.getBasic(graphType::TYPE_unit)));
+    insert(new TypeEntry("bool" , types.getBasic(graphType::TYPE_bool)));
 }
-TypeEntry* TypeTable::insertType(string name, bool overwrite) {
-    CustomTypeGraph *customType = new CustomTypeGraph(name);
+TypeEntry* TypeTable::insertType(Symbol name, bool overwrite) {
+    CustomTypeGraph *customType = new CustomTypeGraph(name.str());
     TypeEntry *typeEntry = new TypeEntry(name, customType);
     return dynamic_cast<TypeEntry *>(insert(typeEntry, overwrite));
 }
-TypeEntry* TypeTable::lookupType(string name, bool err) {
+TypeEntry* TypeTable::lookupType(Symbol name, bool err) {
     return dynamic_cast<TypeEntry *>(lookup(name, err));
 }
 TypeTable::~TypeTable() {
@@ -318,12 +288,12 @@ TypeTable::~TypeTable() {
 
 ConstructorTable::ConstructorTable(bool debug)
 : BaseTable("\033[1m\033[34mConstructorTable\033[0m", debug) {}
-ConstructorEntry* ConstructorTable::insertConstructor(string name, bool overwrite) {
-    ConstructorTypeGraph *constrType = new ConstructorTypeGraph(name);
+ConstructorEntry* ConstructorTable::insertConstructor(Symbol name, bool overwrite) {
+    ConstructorTypeGraph *constrType = new ConstructorTypeGraph(name.str());
     ConstructorEntry *constructorEntry = new ConstructorEntry(name, constrType);
     return dynamic_cast<ConstructorEntry *>(insert(constructorEntry, overwrite));
 }
-ConstructorEntry* ConstructorTable::lookupConstructor(string name, bool err) {
+ConstructorEntry* ConstructorTable::lookupConstructor(Symbol name, bool err) {
     return dynamic_cast<ConstructorEntry *>(lookup(name, err));
 }
 ConstructorTable::~ConstructorTable() {}
@@ -332,10 +302,10 @@ ConstructorTable::~ConstructorTable() {}
 /**          SymbolEntry method implementations              */
 /*************************************************************/
 TypeGraph* SymbolEntry::getTypeGraph() { return typeGraph; }
-SymbolEntry::SymbolEntry(std::string n, TypeGraph *t)
+SymbolEntry::SymbolEntry(Symbol n, TypeGraph *t)
 : name(n), typeGraph(t) {};
 
-FunctionEntry::FunctionEntry(std::string n, TypeGraph *t)
+FunctionEntry::FunctionEntry(Symbol n, TypeGraph *t)
 : SymbolEntry(n, t) {}
 
 // FunctionTypeGraph* FunctionEntry::getTypeGraph() {
@@ -348,7 +318,7 @@ FunctionEntry::FunctionEntry(std::string n, TypeGraph *t)
 void FunctionEntry::addParam(TypeGraph *param, bool push_back) {
     getTypeGraph()->addParam(param, push_back);
 }
-ArrayEntry::ArrayEntry(std::string n, TypeGraph *t)
+ArrayEntry::ArrayEntry(Symbol n, TypeGraph *t)
 : SymbolEntry(n, t) {}
 
 // ArrayTypeGraph* ArrayEntry::getTypeGraph() {
@@ -359,7 +329,7 @@ ArrayEntry::ArrayEntry(std::string n, TypeGraph *t)
 //     exit(1);
 // }
 
-RefEntry::RefEntry(std::string n, TypeGraph *t)
+RefEntry::RefEntry(Symbol n, TypeGraph *t)
 : SymbolEntry(n, t) {}
 // RefTypeGraph* RefEntry::getTypeGraph() {
 //     if (typeGraph->isRef())
@@ -369,7 +339,7 @@ RefEntry::RefEntry(std::string n, TypeGraph *t)
 //     exit(1);
 // }
 
-TypeEntry::TypeEntry(std::string n, TypeGraph *t)
+TypeEntry::TypeEntry(Symbol n, TypeGraph *t)
     :SymbolEntry(n,t),
     constructors(new std::vector<ConstructorEntry *>()) {}
 TypeEntry::~TypeEntry() { 
@@ -388,7 +358,7 @@ void TypeEntry::addConstructor(ConstructorEntry *constr) {
 //     return dynamic_cast<CustomTypeGraph *>(typeGraph);
 // }
 
-ConstructorEntry::ConstructorEntry(std::string n, TypeGraph *t)
+ConstructorEntry::ConstructorEntry(Symbol n, TypeGraph *t)
     : SymbolEntry(n,t) {};
 void ConstructorEntry::setTypeEntry(TypeEntry *t)
     { typeEntry = t; }
@@ -3,7 +3,9 @@
 #include <cstdlib>
 #include <vector>
 #include <string>
-#include <map>
+#include <unordered_map>
+#include "intern.hpp"
+#include "scopedtable.hpp"
 #include "types.hpp"
 
 /*************************************************************/
@@ -13,11 +15,11 @@
 class SymbolEntry {
 public:
     // Id associated with SymbolEntry
-    std::string name;
+    Symbol name;
     // Holds pointer to Type Graph of entry
     TypeGraph *typeGraph;
     TypeGraph* getTypeGraph();
-    SymbolEntry(std::string n, TypeGraph *t);
+    SymbolEntry(Symbol n, TypeGraph *t);
     virtual ~SymbolEntry() {}
 };
 
@@ -29,7 +31,7 @@ class ConstructorEntry;
 
 class FunctionEntry : public SymbolEntry {
 public:
-    FunctionEntry(std::string n, TypeGraph *t);
+    FunctionEntry(Symbol n, TypeGraph *t);
     // virtual FunctionTypeGraph* getTypeGraph();
     /** Utility method for creating more complex FunctionTypeGraphs 
      * @param push_back If true then param is appended, else inserted at start */
@@ -38,13 +40,13 @@ public:
 };
 class ArrayEntry : public SymbolEntry {
 public:
-    ArrayEntry(std::string n, TypeGraph *t);
+    ArrayEntry(Symbol n, TypeGraph *t);
     // virtual ArrayTypeGraph* getTypeGraph();
     ~ArrayEntry() {};
 };
 class RefEntry : public SymbolEntry {
 public:
-    RefEntry(std::string n, TypeGraph *t);
+    RefEntry(Symbol n, TypeGraph *t);
     // virtual RefTypeGraph* getTypeGraph();
     bool isDynamic();
     bool isAllocated();
@@ -62,7 +64,7 @@ public:
     // Adds a constructor to this type (doesn't add to TypeTable)
     void addConstructor(ConstructorEntry *constr);
     // virtual CustomTypeGraph* getTypeGraph();
-    TypeEntry(std::string n, TypeGraph *t);
+    TypeEntry(Symbol n, TypeGraph *t);
     ~TypeEntry();
 };
 class ConstructorEntry: public SymbolEntry {
@@ -73,15 +75,14 @@ public:
     void setTypeEntry(TypeEntry *t);
     void addType(TypeGraph *field);
     // virtual ConstructorTypeGraph* getTypeGraph();
-    ConstructorEntry(std::string n, TypeGraph *t);
+    ConstructorEntry(Symbol n, TypeGraph *t);
     ~ConstructorEntry() {};
 };
 /*************************************************************/
 /**                SymbolTable class                         */
 /*************************************************************/
 class SymbolTable {
-    /** Pointer to a stack of pointers to maps */
-    std::vector<std::map<std::string, SymbolEntry *> *> *Table;
+    ScopedTable<SymbolEntry *> Table;
     /** Inserts a new symbol entry in the current active scope */
     SymbolEntry* insert(SymbolEntry *entry, bool overwrite = true);
     void insertLibFunctions();
@@ -97,25 +98,25 @@ public:
     bool closeScope(bool deleteEntries = true);
 //! Insert wrappers
     /** Inserts an id with the provided TypeGraph as is */
-    SymbolEntry* insertBasic(std::string name, TypeGraph *t, bool overwrite = true);
-    // SymbolEntry* insertUnknown(std::string name, AST *node, bool overwrite = true);
+    SymbolEntry* insertBasic(Symbol name, TypeGraph *t, bool overwrite = true);
+    // SymbolEntry* insertUnknown(Symbol name, AST *node, bool overwrite = true);
     /** Inserts an id with the provided TypeGraph as the result of a parameterless FunctionTypeGraph */
-    FunctionEntry* insertFunction(std::string name, TypeGraph *resT, bool overwrite = true);
+    FunctionEntry* insertFunction(Symbol name, TypeGraph *resT, bool overwrite = true);
     /** Inserts an id with ArrayTypeGraph of the provided type and dimensions */
-    ArrayEntry* insertArray(std::string name, TypeGraph *containedT, int dimensions,
+    ArrayEntry* insertArray(Symbol name, TypeGraph *containedT, int dimensions,
                              bool overwrite = true);
     /** Inserts an id with RefTypeGraph of the provided type and specifications */
-    RefEntry* insertRef(std::string name, TypeGraph *pointedT, bool overwrite = true);
+    RefEntry* insertRef(Symbol name, TypeGraph *pointedT, bool overwrite = true);
 //! Lookup wrappers
     /** Looks up the existence of an identifier 
      *  If not found and err = true, exits, otherwise returns nullptr */
-    SymbolEntry* lookup(std::string name, bool err = true);
+    SymbolEntry* lookup(Symbol name, bool err = true);
     /** Looks up a name associated with a callable (function) */
-    FunctionEntry* lookupFunction(std::string name, bool err = true);
+    FunctionEntry* lookupFunction(Symbol name, bool err = true);
     /** Looks up a name assocated with an array (dereferencable via '[]') */
-    ArrayEntry* lookupArray(std::string name, bool err = true);
+    ArrayEntry* lookupArray(Symbol name, bool err = true);
     /** Looks up a name associated with a reference type (dereferencable via '!') */
-    RefEntry* lookupRef(std::string name, bool err = true);
+    RefEntry* lookupRef(Symbol name, bool err = true);
     void enable_logs();
     ~SymbolTable();
 };
@@ -130,9 +131,9 @@ class BaseTable {
     std::string kind;
 public:
     /** Pointer to a map of name-Entry_pointer pairs*/
-    std::map<std::string, SymbolEntry *> *Table;
+    std::unordered_map<Symbol, SymbolEntry *> *Table;
     BaseTable(std::string kind = "BaseTable", bool debug = false);
-    SymbolEntry *lookup(std::string name, bool err = true);
+    SymbolEntry *lookup(Symbol name, bool err = true);
     SymbolEntry* insert(SymbolEntry *entry, bool overwrite = false);
     void enable_logs();
     virtual ~BaseTable();
@@ -142,18 +143,18 @@ class TypeTable : public BaseTable {
 public:
     TypeTable(bool debug = false);
         /** insert wrapper for TypeEntries */
-    TypeEntry* insertType(std::string name, bool overwrite = false);
+    TypeEntry* insertType(Symbol name, bool overwrite = false);
     /** lookup wrapper for TypeEntries */
-    TypeEntry* lookupType(std::string name, bool err = true);
+    TypeEntry* lookupType(Symbol name, bool err = true);
     ~TypeTable();
 };
 class ConstructorTable : public BaseTable {
 public:
     ConstructorTable(bool debug = false);
     /** insert wrapper for ConstructorEntries */
-    ConstructorEntry* insertConstructor(std::string name, bool overwrite = false);
+    ConstructorEntry* insertConstructor(Symbol name, bool overwrite = false);
     /** lookup wrapper for ConstructorEntries */
-    ConstructorEntry* lookupConstructor(std::string name, bool err = true);
+    ConstructorEntry* lookupConstructor(Symbol name, bool err = true);
     ~ConstructorTable();
 };
 
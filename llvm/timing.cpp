@@ -0,0 +1,107 @@
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <sys/resource.h>
+
+#include "timing.hpp"
+
+PhaseTimer phaseTimer;
+
+double PhaseTimer::wallNow()
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+double PhaseTimer::cpuNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+long PhaseTimer::peakRssNow()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+int PhaseTimer::findOrAdd(std::string name)
+{
+    int parent = stack.empty() ? -1 : stack.back().phase;
+    for (int i = 0; i < (int)phases.size(); i++)
+        if (phases[i].parent == parent && phases[i].name == name)
+            return i;
+    Phase p;
+    p.name = name;
+    p.parent = parent;
+    p.depth = parent == -1 ? 0 : phases[parent].depth + 1;
+    phases.push_back(p);
+    return phases.size() - 1;
+}
+
+void PhaseTimer::enable()
+{
+    enabled = true;
+}
+bool PhaseTimer::isEnabled()
+{
+    return enabled;
+}
+void PhaseTimer::start(std::string name)
+{
+    if (!enabled)
+        return;
+    stack.push_back({findOrAdd(name), wallNow(), cpuNow()});
+}
+void PhaseTimer::stop()
+{
+    if (!enabled || stack.empty())
+        return;
+    Running r = stack.back();
+    stack.pop_back();
+    Phase &p = phases[r.phase];
+    p.count++;
+    p.wall += wallNow() - r.wallStart;
+    p.cpu += cpuNow() - r.cpuStart;
+    p.peakRss = peakRssNow();
+}
+void PhaseTimer::stopAll()
+{
+    while (enabled && !stack.empty())
+        stop();
+}
+
+void PhaseTimer::printTable(std::ostream &out)
+{
+    out << std::left << std::setw(28) << "phase"
+        << std::right << std::setw(12) << "wall (ms)"
+        << std::setw(12) << "cpu (ms)"
+        << std::setw(16) << "peak RSS (KB)"
+        << std::setw(8) << "runs" << std::endl;
+    for (auto &p : phases)
+    {
+        out << std::left << std::setw(28) << std::string(2 * p.depth, ' ') + p.name
+            << std::right << std::fixed << std::setprecision(3)
+            << std::setw(12) << p.wall
+            << std::setw(12) << p.cpu
+            << std::setw(16) << p.peakRss
+            << std::setw(8) << p.count << std::endl;
+    }
+}
+void PhaseTimer::printJSON(std::ostream &out)
+{
+    out << "{\"phases\": [";
+    for (int i = 0; i < (int)phases.size(); i++)
+    {
+        Phase &p = phases[i];
+        out << (i ? ", " : "")
+            << "{\"name\": \"" << p.name << "\""
+            << ", \"parent\": "
+            << (p.parent == -1 ? "null" : "\"" + phases[p.parent].name + "\"")
+            << std::fixed << std::setprecision(3)
+            << ", \"wall_ms\": " << p.wall
+            << ", \"cpu_ms\": " << p.cpu
+            << ", \"peak_rss_kb\": " << p.peakRss
+            << ", \"runs\": " << p.count << "}";
+    }
+    out << "]}" << std::endl;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/** Collects wall time, CPU time and peak RSS of the compilation phases.
+ * Phases nest, and a phase entered repeatedly under the same parent
+ * (e.g. the per-function pass runs) is accumulated into one entry */
+class PhaseTimer
+{
+    struct Phase
+    {
+        std::string name;
+        int parent, depth;
+        unsigned long count = 0;
+        double wall = 0, cpu = 0; // milliseconds
+        long peakRss = 0;         // kilobytes
+    };
+    struct Running
+    {
+        int phase;
+        double wallStart, cpuStart;
+    };
+    bool enabled = false;
+    std::vector<Phase> phases;
+    std::vector<Running> stack;
+
+    static double wallNow();
+    static double cpuNow();
+    static long peakRssNow();
+    int findOrAdd(std::string name);
+
+public:
+    void enable();
+    bool isEnabled();
+    void start(std::string name);
+    void stop();
+    /** Stops the phases still running, e.g. on exiting in the middle of one */
+    void stopAll();
+    void printTable(std::ostream &out);
+    void printJSON(std::ostream &out);
+};
+
+extern PhaseTimer phaseTimer;
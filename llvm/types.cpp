@@ -5,7 +5,6 @@
 #include "infer.hpp"
 #include "ast.hpp"
 #include <llvm/IR/IRBuilder.h>
-#include <llvm/IR/LegacyPassManager.h>
 
 /*************************************************************/
 /**                    Base TypeGraph                        */
@@ -15,6 +14,12 @@ void TypeGraph::wrongCall(std::string functionName) {
     log("Function '" + functionName + "' called for wrong " +
         "subClass, exiting...");
 }
+void TypeGraph::checkMutable(std::string functionName) {
+    if (interned) {
+        log("Function '" + functionName + "' called for interned type, exiting...");
+        exit(1);
+    }
+}
 TypeGraph::TypeGraph(graphType t): t(t) {}
 graphType const & TypeGraph::getSubClass() { return t; }
 std::string TypeGraph::stringifyType() {
@@ -45,6 +50,9 @@ bool TypeGraph::isUnknown()     { return t == graphType::TYPE_unknown;  }
 bool TypeGraph::isBasic() {
     return isInt() || isUnit() || isBool() || isChar() || isFloat();
 }
+bool TypeGraph::isInterned() { return interned; }
+bool TypeGraph::isResolved() { return interned || resolved || isCustom(); }
+void TypeGraph::markResolved() { resolved = true; }
 bool TypeGraph::isDeletable() { return isFunction() || isArray() || isRef(); }
 bool TypeGraph::isUnknownRefOrArray() {
     return (isRef() || isArray()) && (getContainedType()->isUnknown());
@@ -56,7 +64,7 @@ TypeGraph* TypeGraph::getContainedType() {
 int TypeGraph::getDimensions() {
     wrongCall("getDimensions()"); exit(1);
 }
-std::vector<TypeGraph *>* TypeGraph::getParamTypes() {
+llvm::ArrayRef<TypeGraph *> TypeGraph::getParamTypes() {
     wrongCall("getParamTypes()"); exit(1);
 }
 TypeGraph* TypeGraph::getResultType() {
@@ -71,7 +79,7 @@ void TypeGraph::addParam(TypeGraph *param, bool push_back) {
 TypeGraph* TypeGraph::getParamType(unsigned int index) {
     wrongCall("getParamType()"); exit(1);
 }
-std::vector<TypeGraph *>* TypeGraph::getFields() {
+llvm::ArrayRef<TypeGraph *> TypeGraph::getFields() {
     wrongCall("getFields()"); exit(1);
 }
 void TypeGraph::addField(TypeGraph *field) { wrongCall("addField"); exit(1); }
@@ -149,7 +157,7 @@ unsigned long UnknownTypeGraph::curr = 1;
 UnknownTypeGraph::UnknownTypeGraph(bool can_be_array, bool can_be_func, bool only_int_char_float):
 TypeGraph(graphType::TYPE_unknown), tmp_id(curr++),
 can_be_array(can_be_array), can_be_func(can_be_func), only_int_char_float(only_int_char_float) {
-    inf.initSubstitution(getTmpName());
+    inf.initSubstitution(this);
 }
 std::string UnknownTypeGraph::getTmpName() {
     return "@" + std::to_string(tmp_id);
@@ -237,10 +245,15 @@ int ArrayTypeGraph::getDimensions() {
 }
 bool ArrayTypeGraph::equals(TypeGraph *o) {
     if (this == o) return true;
+    if (isInterned() && o->isInterned()) return false;
+    // arrays of unknown dimensions are left for inference to match
     return o->isArray() &&
+           (getDimensions() == -1 || o->getDimensions() == -1 ||
+            getDimensions() == o->getDimensions()) &&
            getContainedType()->equals(o->getContainedType());
 }
 void ArrayTypeGraph::changeInner(TypeGraph *replacement, unsigned int index) {
+    checkMutable("changeInner()");
     Type = replacement;
 }
 int ArrayTypeGraph::getBound() { return *lowBound; }
@@ -257,7 +270,6 @@ void ArrayTypeGraph::setDimensions(int fixedDimensions) {
     dimensions = fixedDimensions; // sets personal int
     *lowBound = fixedDimensions; // sets the positions int
 }
-ArrayTypeGraph::~ArrayTypeGraph() { if (Type->isDeletable()) delete Type; }
 
 /*************************************************************/
 /**                    Ref TypeGraph                         */
@@ -276,20 +288,21 @@ std::string RefTypeGraph::stringifyTypeClean() {
 TypeGraph* RefTypeGraph::getContainedType() { return Type; }
 bool RefTypeGraph::equals(TypeGraph *o) {
     if (this == o) return true;
+    if (isInterned() && o->isInterned()) return false;
     return o->isRef() &&
            getContainedType()->equals(o->getContainedType());
 }
 void RefTypeGraph::changeInner(TypeGraph *replacement, unsigned int index) {
+    checkMutable("changeInner()");
     Type = replacement;
 }
-RefTypeGraph::~RefTypeGraph() { if (Type->isDeletable()) delete Type; }
 
 /*************************************************************/
 /**                    Function TypeGraph                    */
 /*************************************************************/
 
-FunctionTypeGraph::FunctionTypeGraph(TypeGraph *resultType)
-: TypeGraph(graphType::TYPE_function), paramTypes(new std::vector<TypeGraph *>()),
+FunctionTypeGraph::FunctionTypeGraph(TypeGraph *resultType, llvm::ArrayRef<TypeGraph *> paramTypes)
+: TypeGraph(graphType::TYPE_function), paramTypes(paramTypes.begin(), paramTypes.end()),
 resultType(resultType) {}
 std::string FunctionTypeGraph::stringifyParams() {
     if (getParamCount() == 0) {
@@ -321,31 +334,33 @@ std::string FunctionTypeGraph::stringifyTypeClean() {
     return stringifyParams() + " -> " +
            getResultType()->stringifyTypeClean();
 }
-std::vector<TypeGraph *>* FunctionTypeGraph::getParamTypes() {
+llvm::ArrayRef<TypeGraph *> FunctionTypeGraph::getParamTypes() {
     return paramTypes;
 }
 TypeGraph* FunctionTypeGraph::getResultType() {
     return resultType;
 }
 int FunctionTypeGraph::getParamCount() {
-    return paramTypes->size();
+    return paramTypes.size();
 }
 void FunctionTypeGraph::addParam(TypeGraph *param, bool push_back) {
+    checkMutable("addParam()");
     if (push_back)
-        paramTypes->push_back(param);
+        paramTypes.push_back(param);
     else
-        paramTypes->insert(paramTypes->begin(), param);
+        paramTypes.insert(paramTypes.begin(), param);
 }
 TypeGraph* FunctionTypeGraph::getParamType(unsigned int index) {
-    if (index >= paramTypes->size()) {
+    if (index >= paramTypes.size()) {
         std::cout << "Out of bounds param requested\n";
         exit(1);
     }
-    return (*paramTypes)[index];
+    return paramTypes[index];
 }
 
 bool FunctionTypeGraph::equals(TypeGraph *o) {
     if (this == o) return true;
+    if (isInterned() && o->isInterned()) return false;
     if (o->isFunction() && getParamCount() == o->getParamCount()) {
         for (int i = 0; i < getParamCount(); i++) {
             if (!getParamType(i)->equals(o->getParamType(i)))
@@ -356,45 +371,40 @@ bool FunctionTypeGraph::equals(TypeGraph *o) {
     return false;
 }
 void FunctionTypeGraph::changeInner(TypeGraph *replacement, unsigned int index) {
-    if (index > paramTypes->size()) {
+    checkMutable("changeInner()");
+    if (index > paramTypes.size()) {
         std::cout << "Out of bounds param requested\n";
         exit(1);
-    } else if (index == paramTypes->size()) { // no reason this is chosen
+    } else if (index == paramTypes.size()) { // no reason this is chosen
         resultType = replacement;
     } else {
-        (*paramTypes)[index] = replacement;
+        paramTypes[index] = replacement;
     }
 }
-FunctionTypeGraph::~FunctionTypeGraph() {
-    for (auto &paramType: *paramTypes) 
-        if (paramType->isDeletable()) delete paramType;
-    if (resultType->isDeletable()) delete resultType;;
-}
 
 /*************************************************************/
 /**                    Constructor TypeGraph                 */
 /*************************************************************/
 
 ConstructorTypeGraph::ConstructorTypeGraph(std::string name):TypeGraph(graphType::TYPE_record),
-customType(nullptr), name(name),
-fields(new std::vector<TypeGraph *>()) {}
+customType(nullptr), name(name) {}
 std::string ConstructorTypeGraph::stringifyType() {
     return "\033[4m" + stringifyTypeClean() + "\033[0m";
 }
 std::string ConstructorTypeGraph::stringifyTypeClean() {
     return name;
 }
-std::vector<TypeGraph *>* ConstructorTypeGraph::getFields() { return fields; }
-void ConstructorTypeGraph::addField(TypeGraph *field) { fields->push_back(field); }
+llvm::ArrayRef<TypeGraph *> ConstructorTypeGraph::getFields() { return fields; }
+void ConstructorTypeGraph::addField(TypeGraph *field) { fields.push_back(field); }
 void ConstructorTypeGraph::setTypeGraph(CustomTypeGraph *owningType) { customType = owningType; }
 CustomTypeGraph* ConstructorTypeGraph::getCustomType() { return customType; }
-int ConstructorTypeGraph::getFieldCount() { return fields->size(); }
+int ConstructorTypeGraph::getFieldCount() { return fields.size(); }
 TypeGraph* ConstructorTypeGraph::getFieldType(unsigned int index) {
-    if (index >= fields->size()) {
+    if (index >= fields.size()) {
         std::cout << "Out of bounds constructor field requested";
         exit(1);
     }
-    return (*fields)[index];
+    return fields[index];
 }
 bool ConstructorTypeGraph::equals(TypeGraph *o) {
     if (this == o) return true;
@@ -415,11 +425,6 @@ std::string ConstructorTypeGraph::getName()
 {
     return name;
 }
-ConstructorTypeGraph::~ConstructorTypeGraph() {
-    for (auto &field: *fields)
-        if (field->isDeletable())
-            delete field;
-}
 
 /*************************************************************/
 /**                     Custom TypeGraph                     */
@@ -483,6 +488,98 @@ CustomTypeGraph::~CustomTypeGraph() {
         delete constructor;
 }
 
+/*************************************************************/
+/**                     Type Context                         */
+/*************************************************************/
+
+TypeContext::TypeContext() {
+    basicTypes[(int)graphType::TYPE_unit] = make<UnitTypeGraph>();
+    basicTypes[(int)graphType::TYPE_int] = make<IntTypeGraph>();
+    basicTypes[(int)graphType::TYPE_float] = make<FloatTypeGraph>();
+    basicTypes[(int)graphType::TYPE_bool] = make<BoolTypeGraph>();
+    basicTypes[(int)graphType::TYPE_char] = make<CharTypeGraph>();
+}
+TypeGraph* TypeContext::getBasic(graphType t) {
+    return basicTypes[(int)t];
+}
+TypeGraph* TypeContext::find(std::size_t hash, graphType t, int dimensions,
+                             llvm::ArrayRef<TypeGraph *> parts) {
+    auto range = nodes.equal_range(hash);
+    for (auto it = range.first; it != range.second; it++) {
+        TypeGraph *node = it->second;
+        if (node->getSubClass() != t) continue;
+        // Parts are interned, so they are equal only if they are the same node
+        switch (t) {
+            case graphType::TYPE_ref:
+                if (node->getContainedType() == parts[0]) return node;
+                break;
+            case graphType::TYPE_array:
+                if (node->getDimensions() == dimensions &&
+                    node->getContainedType() == parts[0]) return node;
+                break;
+            case graphType::TYPE_function:
+                if (node->getParamTypes() == parts.drop_back() &&
+                    node->getResultType() == parts.back()) return node;
+                break;
+            default:
+                break;
+        }
+    }
+    return nullptr;
+}
+static std::size_t hashParts(graphType t, int dimensions, llvm::ArrayRef<TypeGraph *> parts) {
+    std::size_t hash = (std::size_t)t * 31 + dimensions;
+    for (auto *part: parts)
+        hash = hash * 31 + std::hash<TypeGraph *>()(part);
+    return hash;
+}
+TypeGraph* TypeContext::getRef(TypeGraph *refType) {
+    if (!refType->isInterned()) return new RefTypeGraph(refType);
+
+    std::size_t hash = hashParts(graphType::TYPE_ref, 0, refType);
+    std::lock_guard<std::mutex> guard(lock);
+    TypeGraph *node = find(hash, graphType::TYPE_ref, 0, refType);
+    if (!node) {
+        node = make<RefTypeGraph>(refType);
+        nodes.insert({hash, node});
+    }
+    return node;
+}
+TypeGraph* TypeContext::getArray(int dimensions, TypeGraph *containedType) {
+    // Unknown dimensions are inferred later, changing the node
+    if (dimensions < 1 || !containedType->isInterned())
+        return new ArrayTypeGraph(dimensions, containedType);
+
+    std::size_t hash = hashParts(graphType::TYPE_array, dimensions, containedType);
+    std::lock_guard<std::mutex> guard(lock);
+    TypeGraph *node = find(hash, graphType::TYPE_array, dimensions, containedType);
+    if (!node) {
+        node = make<ArrayTypeGraph>(dimensions, containedType);
+        nodes.insert({hash, node});
+    }
+    return node;
+}
+TypeGraph* TypeContext::getFunction(llvm::ArrayRef<TypeGraph *> paramTypes, TypeGraph *resultType) {
+    llvm::SmallVector<TypeGraph *, 8> parts(paramTypes.begin(), paramTypes.end());
+    parts.push_back(resultType);
+    for (auto *part: parts)
+        if (!part->isInterned()) return new FunctionTypeGraph(resultType, paramTypes);
+
+    std::size_t hash = hashParts(graphType::TYPE_function, 0, parts);
+    std::lock_guard<std::mutex> guard(lock);
+    TypeGraph *node = find(hash, graphType::TYPE_function, 0, parts);
+    if (!node) {
+        node = make<FunctionTypeGraph>(resultType, paramTypes);
+        nodes.insert({hash, node});
+    }
+    return node;
+}
+
+TypeContext &typeContext() {
+    static TypeContext *context = new TypeContext();
+    return *context;
+}
+
 /*************************************************************/
 /**                     LLVM Functions                       */
 /*************************************************************/
@@ -565,7 +662,7 @@ llvm::PointerType* RefTypeGraph::getLLVMType(llvm::Module *TheModule)
 std::vector<llvm::Type *> FunctionTypeGraph::getLLVMParamTypes(llvm::Module *TheModule)
 {
     std::vector<llvm::Type *> LLVMParamTypes = {};
-    for(auto p: *paramTypes)
+    for(auto p: paramTypes)
     {
         LLVMParamTypes.push_back(p->getLLVMType(TheModule));
     }
@@ -575,10 +672,23 @@ llvm::Type *FunctionTypeGraph::getLLVMResultType(llvm::Module *TheModule)
 {
     return resultType->getLLVMType(TheModule);
 }
-llvm::PointerType* FunctionTypeGraph::getLLVMType(llvm::Module *TheModule)
+llvm::PointerType* FunctionTypeGraph::getLLVMCodeType(llvm::Module *TheModule)
 {
     llvm::Type *LLVMResultType = getLLVMResultType(TheModule);
 
+    auto LLVMParamTypes = getLLVMParamTypes(TheModule);
+    LLVMParamTypes.push_back(llvm::Type::getInt8PtrTy(TheModule->getContext()));
+    return llvm::FunctionType::get(LLVMResultType, LLVMParamTypes, false)->getPointerTo();
+}
+llvm::Type* FunctionTypeGraph::getLLVMType(llvm::Module *TheModule)
+{
+    if (AST::usesFatClosures()) {
+        return llvm::StructType::get(TheModule->getContext(),
+            {getLLVMCodeType(TheModule), llvm::Type::getInt8PtrTy(TheModule->getContext())});
+    }
+
+    llvm::Type *LLVMResultType = getLLVMResultType(TheModule);
+
     auto LLVMParamTypes = getLLVMParamTypes(TheModule);
     llvm::FunctionType *tempType = llvm::FunctionType::get(LLVMResultType, LLVMParamTypes, false);
     // This returns a pointer of the function type
@@ -589,7 +699,7 @@ llvm::StructType* ConstructorTypeGraph::getLLVMType(llvm::Module *TheModule)
     std::vector<llvm::Type *> LLVMTypeList = {};
 
     // Add the rest of the fields of the constructor
-    for(auto f: *fields)
+    for(auto f: fields)
     {
         LLVMTypeList.push_back(f->getLLVMType(TheModule));
     }
@@ -655,7 +765,7 @@ llvm::Value *AST::equalityHelper(llvm::Value *lhsVal,
     if (type->isCustom() && structural)
     {   
         if (CustomTypeGraph *tmpCstType = dynamic_cast<CustomTypeGraph*>(type)) {
-            llvm::Function *cstTypeEqFunc = tmpCstType->getStructEqFunc(TheModule, TheFPM);
+            llvm::Function *cstTypeEqFunc = tmpCstType->getStructEqFunc(TheModule);
             return TmpB.CreateCall(cstTypeEqFunc, {lhsVal, rhsVal}, "strcteq.equals");
         }
         else { // internal error
@@ -680,8 +790,7 @@ llvm::Value *AST::equalityHelper(llvm::Value *lhsVal,
 }
 
 
-llvm::Function *CustomTypeGraph::getStructEqFunc(llvm::Module *TheModule, 
-                                                 llvm::legacy::FunctionPassManager *TheFPM) {
+llvm::Function *CustomTypeGraph::getStructEqFunc(llvm::Module *TheModule) {
 
     // if it has been already declared and saved, then just return it
     if (structEqFunc)
@@ -824,7 +933,6 @@ llvm::Function *CustomTypeGraph::getStructEqFunc(llvm::Module *TheModule,
     TmpB.SetInsertPoint(exitBB);
     TmpB.CreateRet(resPhi);
 
-    TheFPM->run(*structEqFunc);
 
     return structEqFunc;
 }
\ No newline at end of file
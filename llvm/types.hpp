@@ -3,10 +3,15 @@
 
 #include <vector>
 #include <string>
+#include <mutex>
+#include <unordered_map>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Module.h>
-#include <llvm/IR/LegacyPassManager.h>
+
+#include "arena.hpp"
 
 enum class graphType { TYPE_unknown, TYPE_unit, TYPE_int, TYPE_float, TYPE_bool,
             TYPE_char, TYPE_ref, TYPE_array, TYPE_function, TYPE_custom, TYPE_record };
@@ -18,7 +23,15 @@ class ConstructorTypeGraph;
 /** Base Type Graph class from which all others are derived */
 class TypeGraph {
     graphType t;
+    // Set by TypeContext, for the only node of its type
+    bool interned = false;
+    // Set by Inferer::deepSubstitute, once no unknown type is left in it
+    bool resolved = false;
     void wrongCall(std::string functionName);
+    friend class TypeContext;
+protected:
+    // Exits if the node is interned, as others share it
+    void checkMutable(std::string functionName);
 public:
     TypeGraph(graphType t);
     graphType const & getSubClass();
@@ -36,17 +49,22 @@ public:
     bool isConstructor();
     bool isUnknown();
     bool isBasic();
+    bool isInterned();
+    /** @return Whether inference can no longer change it: interned,
+     * custom, or marked by markResolved */
+    bool isResolved();
+    void markResolved();
     bool isDeletable();
     bool isUnknownRefOrArray();
     virtual bool equals(TypeGraph *o) = 0;
     virtual TypeGraph* getContainedType();
     virtual int getDimensions();
-    virtual std::vector<TypeGraph *>* getParamTypes();
+    virtual llvm::ArrayRef<TypeGraph *> getParamTypes();
     virtual TypeGraph* getResultType();
     virtual int getParamCount();
     virtual void addParam(TypeGraph *param, bool push_back = true);
     virtual TypeGraph* getParamType(unsigned int index);
-    virtual std::vector<TypeGraph *>* getFields();
+    virtual llvm::ArrayRef<TypeGraph *> getFields();
     virtual void addField(TypeGraph *field);
     virtual void setTypeGraph(CustomTypeGraph *owningType);
     virtual CustomTypeGraph* getCustomType();
@@ -73,6 +91,9 @@ public:
     virtual std::vector<llvm::Type *> getLLVMParamTypes(llvm::Module *TheModule);
     virtual llvm::Type *getLLVMResultType(llvm::Module *TheModule);
     virtual ~TypeGraph() {}
+    /** Allocated in the compilation's arena, deleting one does nothing */
+    static void *operator new(std::size_t size) { return typeArena().allocate(size); }
+    static void operator delete(void *) {}
 };
 /************************************************************/
 
@@ -156,7 +177,6 @@ public:
     void setDimensions(int fixedDimensions) override;
     void changeInner(TypeGraph *replacement, unsigned int index = 0) override;
     virtual llvm::PointerType* getLLVMType(llvm::Module *TheModule) override;
-    ~ArrayTypeGraph();
 };
 class RefTypeGraph : public TypeGraph {
     TypeGraph *Type;
@@ -168,17 +188,17 @@ public:
     bool equals(TypeGraph *o) override;
     void changeInner(TypeGraph *replacement, unsigned int index = 0) override;
     virtual llvm::PointerType* getLLVMType(llvm::Module *TheModule) override;
-    ~RefTypeGraph();
 };
 class FunctionTypeGraph : public TypeGraph {
-    std::vector<TypeGraph *> *paramTypes; 
+    // Inline for the usual few parameters
+    llvm::SmallVector<TypeGraph *, 4> paramTypes;
     TypeGraph *resultType;
     std::string stringifyParams();
 public:
-    FunctionTypeGraph(TypeGraph *resultType);
+    FunctionTypeGraph(TypeGraph *resultType, llvm::ArrayRef<TypeGraph *> paramTypes = {});
     std::string stringifyType() override;
     std::string stringifyTypeClean() override;
-    std::vector<TypeGraph *>* getParamTypes() override;
+    llvm::ArrayRef<TypeGraph *> getParamTypes() override;
     TypeGraph* getResultType() override;
     int getParamCount() override;
     /** Utility method for creating more complex FunctionTypeGraphs 
@@ -189,21 +209,23 @@ public:
     void changeInner(TypeGraph *replacement, unsigned int index = 0) override;
     std::vector<llvm::Type *> getLLVMParamTypes(llvm::Module *TheModule) override;
     llvm::Type *getLLVMResultType(llvm::Module *TheModule) override;
-    virtual llvm::PointerType* getLLVMType(llvm::Module *TheModule) override;
-    ~FunctionTypeGraph();
+    /** @return The type of the code of its values, that takes the environment last */
+    llvm::PointerType* getLLVMCodeType(llvm::Module *TheModule);
+    /** A function pointer, or a {code, environment} pair with fat closures */
+    virtual llvm::Type* getLLVMType(llvm::Module *TheModule) override;
 };
 
 /** This represents a singular constructor */
 class ConstructorTypeGraph : public TypeGraph {
     CustomTypeGraph *customType;
     std::string name;
-    std::vector<TypeGraph *> *fields;
+    llvm::SmallVector<TypeGraph *, 4> fields;
     int index = -1; // Useful for codegen of constructor
 public:
     ConstructorTypeGraph(std::string name);
     std::string stringifyType() override;
     std::string stringifyTypeClean() override;
-    std::vector<TypeGraph *>* getFields() override;
+    llvm::ArrayRef<TypeGraph *> getFields() override;
     void addField(TypeGraph *field) override;
     void setTypeGraph(CustomTypeGraph *owningType) override;
     CustomTypeGraph* getCustomType() override;
@@ -213,7 +235,6 @@ public:
     int getIndex();
     std::string getName();
     virtual llvm::StructType* getLLVMType(llvm::Module *TheModule) override;
-    ~ConstructorTypeGraph();
 };
 class CustomTypeGraph : public TypeGraph {
     std::string name;
@@ -231,9 +252,42 @@ public:
     int getConstructorIndex(ConstructorTypeGraph *c);
     int getConstructorIndex(std::string Id);
     virtual llvm::PointerType* getLLVMType(llvm::Module *TheModule) override;
-    llvm::Function* getStructEqFunc(llvm::Module *TheModule,
-                                    llvm::legacy::FunctionPassManager *TheFPM);
+    llvm::Function* getStructEqFunc(llvm::Module *TheModule);
     ~CustomTypeGraph();
 };
 
+/************************************************************/
+
+/** Interns the types made of basic types only, with arrays of known
+ * dimensions, so that each of them has a single node and equals() on two
+ * of them is a pointer compare. Types with unknown or custom types in them
+ * are made afresh, for inference to unify as before.
+ * Interned nodes are never released, nor changed */
+class TypeContext {
+    std::mutex lock;
+    Arena arena;
+    // Indexed by graphType, up to TYPE_char
+    TypeGraph *basicTypes[6] = {};
+    // Interned compound types by the hash of their kind and parts
+    std::unordered_multimap<std::size_t, TypeGraph *> nodes;
+
+    /** @param parts The contained type, or the parameters and the result */
+    TypeGraph *find(std::size_t hash, graphType t, int dimensions, llvm::ArrayRef<TypeGraph *> parts);
+    template <class T, class... Args>
+    T *make(Args &&...args) {
+        T *node = ::new (arena.allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        node->interned = true;
+        return node;
+    }
+public:
+    TypeContext();
+    TypeGraph *getBasic(graphType t);
+    TypeGraph *getRef(TypeGraph *refType);
+    TypeGraph *getArray(int dimensions, TypeGraph *containedType);
+    TypeGraph *getFunction(llvm::ArrayRef<TypeGraph *> paramTypes, TypeGraph *resultType);
+};
+
+/** Made on first use, as the tables make types while statically initialized */
+TypeContext &typeContext();
+
 #endif
\ No newline at end of file